@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "async.h"
+#include "util.h"
+
+
+/*
+ * Enqueues 'kernel(input, output, count)' with its upload and download and
+ * returns at once. The three commands are linked by event wait lists only,
+ * on the runtime's upload, compute and download queues, so several jobs can
+ * be in flight and overlap. 'input' and 'output' must stay valid until
+ * job_wait() returns.
+ */
+void
+job_submit(struct ocl_runtime *rt, struct ocl_job *job, cl_kernel kernel,
+           const void *input, size_t input_size, void *output, size_t output_size, size_t count)
+{
+        cl_int err;
+        cl_ulong count_arg = count;
+
+        memset(job, 0, sizeof(*job));
+        job->rt = rt;
+        job->input = bufpool_acquire(&rt->pool, CL_MEM_READ_ONLY, input_size);
+        job->output = bufpool_acquire(&rt->pool, CL_MEM_WRITE_ONLY, output_size);
+
+        err = clEnqueueWriteBuffer(rt->upload_queue, job->input, CL_FALSE, 0, input_size, input,
+                                   0, NULL, &job->write);
+	ocl_error("Enqueueing job upload", err);
+        profile_event(&rt->profile, job->write, "job input");
+
+        // Arguments are captured at enqueue time, so the kernel can be reused right away
+        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &job->input);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &job->output);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_ulong), &count_arg);
+	ocl_error("Setting job kernel arguments", err);
+        err = opencl_enqueue_range(rt->queue, kernel, count, 0, 1, &job->write, &job->kernel);
+	ocl_error("Enqueueing job kernel", err);
+        profile_event(&rt->profile, job->kernel, "job kernel");
+
+        err = clEnqueueReadBuffer(rt->download_queue, job->output, CL_FALSE, 0, output_size, output,
+                                  1, &job->kernel, &job->read);
+	ocl_error("Enqueueing job download", err);
+        profile_event(&rt->profile, job->read, "job output");
+
+        clFlush(rt->upload_queue);
+        clFlush(rt->queue);
+        clFlush(rt->download_queue);
+}
+
+/*
+ * Returns non-zero once the job's output has reached the host, without
+ * blocking.
+ */
+int
+job_done(struct ocl_job *job)
+{
+        cl_int err;
+        cl_int status;
+
+        err = clGetEventInfo(job->read, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+	ocl_error("Getting event info", err);
+        if(status < 0)
+                ocl_error("Job failed", status);
+        return (status == CL_COMPLETE);
+}
+
+/*
+ * Blocks until the job's output is on the host, then returns its buffers to
+ * the pool.
+ */
+void
+job_wait(struct ocl_job *job)
+{
+        cl_int err;
+
+        err = clWaitForEvents(1, &job->read);
+	ocl_error("Waiting for job", err);
+
+        clReleaseEvent(job->write);
+        clReleaseEvent(job->kernel);
+        clReleaseEvent(job->read);
+        bufpool_release(&job->rt->pool, job->input);
+        bufpool_release(&job->rt->pool, job->output);
+        memset(job, 0, sizeof(*job));
+}
@@ -0,0 +1,25 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+/*
+ * Completion handle of a job submitted with job_submit(). The host only
+ * blocks in job_wait().
+ */
+struct ocl_job {
+        struct ocl_runtime *rt;
+        cl_mem input, output;		// pooled, returned by job_wait()
+        cl_event write, kernel, read;
+};
+
+void job_submit(struct ocl_runtime *rt, struct ocl_job *job, cl_kernel kernel,
+                const void *input, size_t input_size, void *output, size_t output_size, size_t count);
+int job_done(struct ocl_job *job);
+void job_wait(struct ocl_job *job);
+
+#endif //ASYNC_H
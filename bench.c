@@ -0,0 +1,626 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "CL/cl.h"
+
+#include "buffer.h"
+#include "hostexec.h"
+#include "opencl.h"
+#include "sgemm.h"
+#include "square.h"
+#include "util.h"
+
+#define BENCH_MIN (1024)
+#define BENCH_MAX (16 * 1024 * 1024)
+#define BENCH_STEP (4)
+#define BENCH_WARMUP (3)
+#define BENCH_TRIALS (20)
+#define BENCH_SGEMM_MIN (128)		// matrix dimension
+#define BENCH_SGEMM_MAX (2048)
+#define BENCH_SGEMM_STEP (2)
+
+struct bench_result {
+        size_t count;
+        unsigned int trials;
+        double median_ms, p95_ms, p99_ms, min_ms;
+        double in_ms, kernel_ms, out_ms;	// medians of each phase
+};
+
+struct bench_sgemm_result {
+        size_t n;
+        unsigned int trials;
+        double median_ms, p95_ms, min_ms;
+        double gflops;				// at the median time
+};
+
+struct bench_trial {
+        double total_ms, in_ms, kernel_ms, out_ms;
+};
+
+
+static void
+usage(const char *name)
+{
+        printf("Usage: %s [-sgemm] [-min count] [-max count] [-step factor] [-warmup n] [-trials n] [-json] [-o file]\n",
+               name);
+        printf("  -sgemm        time n x n matrix multiplies and report GFLOP/s instead; -min and -max\n");
+        printf("                are then matrix dimensions (default %d to %d, step %d)\n",
+               BENCH_SGEMM_MIN, BENCH_SGEMM_MAX, BENCH_SGEMM_STEP);
+        printf("  -min count    smallest element count (default %d)\n", BENCH_MIN);
+        printf("  -max count    largest element count (default %d)\n", BENCH_MAX);
+        printf("  -step factor  multiply the count by 'factor' between sizes (default %d)\n", BENCH_STEP);
+        printf("  -warmup n     untimed iterations per size (default %d)\n", BENCH_WARMUP);
+        printf("  -trials n     timed iterations per size (default %d)\n", BENCH_TRIALS);
+        printf("  -json         write JSON instead of CSV\n");
+        printf("  -o file       write the results to 'file' instead of stdout\n");
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+        double x = *(const double *)a, y = *(const double *)b;
+        return (x > y) - (x < y);
+}
+
+/*
+ * Nearest-rank percentile 'p' (0..1) of 'n' sorted values.
+ */
+static double
+percentile(const double *sorted, unsigned int n, double p)
+{
+        unsigned int rank = (unsigned int)ceil(p * n);
+        return sorted[(rank > 0) ? rank - 1 : 0];
+}
+
+static double
+median_of(double *values, unsigned int n)
+{
+        qsort(values, n, sizeof(double), compare_double);
+        return percentile(values, n, 0.5);
+}
+
+/*
+ * Time from the start of 'first' to the end of 'last', which completes after
+ * it on the same in-order queue. Releases both events.
+ */
+static double
+event_span_ms(cl_event first, cl_event last)
+{
+        cl_int err;
+        cl_ulong start, end;
+
+        err  = clGetEventProfilingInfo(first, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+        err |= clGetEventProfilingInfo(last, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+	ocl_error("Getting event profiling info", err);
+        clReleaseEvent(first);
+        clReleaseEvent(last);
+        return (end - start) * 1e-6;
+}
+
+/*
+ * Adds 'event' to the span of a phase: span[0] keeps the first event, span[1]
+ * the latest, and events in between are released.
+ */
+static void
+bench_span(cl_event *span, cl_event event, int first)
+{
+        if(first) {
+                clRetainEvent(event);
+                span[0] = event;
+        } else {
+                clReleaseEvent(span[1]);
+        }
+        span[1] = event;
+}
+
+/*
+ * One upload, square pass and download of 'count' floats, spread over
+ * 'parts' input/output buffer pairs of 'part' floats each so that sizes
+ * larger than one device allocation can be benchmarked. All uploads are
+ * enqueued first, then all kernels, then all downloads, and each phase is
+ * timed from its first command's start to its last command's end, including
+ * every launch of a range split by opencl_enqueue_range_span().
+ */
+static void
+bench_device_trial(struct ocl_runtime *rt, cl_kernel kernel, unsigned int width, const cl_mem *input,
+                   const cl_mem *output, size_t parts, size_t part, const float *data, float *results,
+                   size_t count, struct bench_trial *trial)
+{
+        cl_int err;
+        // First and last command of each phase
+        cl_event write[2] = { NULL, NULL }, run[2] = { NULL, NULL }, read[2] = { NULL, NULL };
+        cl_event first, last;
+        double t0, t1;
+
+        t0 = time_seconds();
+        for(size_t p = 0; p < parts; p++) {
+                size_t n = (count - p * part < part) ? count - p * part : part;
+                err = clEnqueueWriteBuffer(rt->queue, input[p], CL_FALSE, 0, sizeof(float) * n, data + p * part,
+                                           0, NULL, &first);
+		ocl_error("Running benchmark trial", err);
+                bench_span(write, first, p == 0);
+        }
+        for(size_t p = 0; p < parts; p++) {
+                size_t n = (count - p * part < part) ? count - p * part : part;
+                cl_ulong count_arg = n;
+
+                err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input[p]);
+                err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output[p]);
+                err |= clSetKernelArg(kernel, 2, sizeof(cl_ulong), &count_arg);
+                err |= opencl_enqueue_range_span(rt->queue, kernel, square_work_items(n, width), 0, 0, NULL,
+                                                 &first, &last);
+		ocl_error("Running benchmark trial", err);
+                bench_span(run, first, p == 0);
+                bench_span(run, last, 0);
+        }
+        for(size_t p = 0; p < parts; p++) {
+                size_t n = (count - p * part < part) ? count - p * part : part;
+                err = clEnqueueReadBuffer(rt->queue, output[p], (p + 1 == parts) ? CL_TRUE : CL_FALSE, 0,
+                                          sizeof(float) * n, results + p * part, 0, NULL, &first);
+		ocl_error("Running benchmark trial", err);
+                bench_span(read, first, p == 0);
+        }
+        t1 = time_seconds();
+
+        trial->total_ms = (t1 - t0) * 1e3;
+        trial->in_ms = event_span_ms(write[0], write[1]);
+        trial->kernel_ms = event_span_ms(run[0], run[1]);
+        trial->out_ms = event_span_ms(read[0], read[1]);
+}
+
+static void
+bench_host_trial(const float *data, float *results, size_t count, struct bench_trial *trial)
+{
+        double t0 = time_seconds();
+        host_run("square", data, results, count);
+        trial->total_ms = (time_seconds() - t0) * 1e3;
+        trial->in_ms = trial->out_ms = 0.0;
+        trial->kernel_ms = trial->total_ms;
+}
+
+/*
+ * Runs 'warmup' untimed and 'trials' timed iterations for one size. On a
+ * device the data is split over as many buffers as one allocation needs.
+ */
+static void
+bench_size(struct ocl_runtime *rt, size_t count, size_t max_alloc, unsigned int warmup, unsigned int trials,
+           const float *data, float *results, struct bench_result *result)
+{
+        struct bench_trial trial;
+        double *total = malloc(sizeof(double) * trials * 4);
+        double *in = total + trials, *kernel = in + trials, *out = kernel + trials;
+        cl_kernel square = NULL;
+        unsigned int width = 1;
+        size_t part = max_alloc / sizeof(float);
+        size_t parts = (count + part - 1) / part;
+        cl_mem *input = malloc(sizeof(cl_mem) * parts * 2), *output = input + parts;
+
+        if(total == NULL || input == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(1);
+        }
+
+        if(!rt->host_fallback) {
+                width = square_vector_width(rt);
+                square = square_kernel(rt, width);
+                // Every part but the last starts on a whole vector
+                part -= part % width;
+                parts = (count + part - 1) / part;
+                for(size_t p = 0; p < parts; p++) {
+                        size_t n = (count - p * part < part) ? count - p * part : part;
+                        input[p] = bufpool_acquire(&rt->pool, CL_MEM_READ_ONLY, sizeof(float) * n);
+                        output[p] = bufpool_acquire(&rt->pool, CL_MEM_WRITE_ONLY, sizeof(float) * n);
+                }
+        }
+
+        for(unsigned int i = 0; i < warmup + trials; i++) {
+                if(rt->host_fallback)
+                        bench_host_trial(data, results, count, &trial);
+                else
+                        bench_device_trial(rt, square, width, input, output, parts, part, data, results, count,
+                                           &trial);
+                if(i < warmup)
+                        continue;
+                total[i - warmup] = trial.total_ms;
+                in[i - warmup] = trial.in_ms;
+                kernel[i - warmup] = trial.kernel_ms;
+                out[i - warmup] = trial.out_ms;
+        }
+
+        if(!rt->host_fallback) {
+                for(size_t p = 0; p < parts; p++) {
+                        bufpool_release(&rt->pool, input[p]);
+                        bufpool_release(&rt->pool, output[p]);
+                }
+        }
+        free(input);
+
+        result->count = count;
+        result->trials = trials;
+        // median_of() sorts, so the percentiles and minimum below see sorted totals
+        result->median_ms = median_of(total, trials);
+        result->p95_ms = percentile(total, trials, 0.95);
+        result->p99_ms = percentile(total, trials, 0.99);
+        result->min_ms = total[0];
+        result->in_ms = median_of(in, trials);
+        result->kernel_ms = median_of(kernel, trials);
+        result->out_ms = median_of(out, trials);
+        free(total);
+}
+
+/*
+ * Copies 'in' to 'out' (of 'len' bytes) escaped for a double-quoted JSON
+ * string ('json' set) or CSV field: JSON escapes quotes, backslashes and
+ * control characters, CSV doubles quotes.
+ */
+static void
+bench_escape(const char *in, char *out, size_t len, int json)
+{
+        size_t used = 0;
+
+        for(; *in != '\0' && used + 7 < len; in++) {
+                unsigned char c = *in;
+                if(json && (c == '"' || c == '\\'))
+                        used += snprintf(out + used, len - used, "\\%c", c);
+                else if(json && c < 0x20)
+                        used += snprintf(out + used, len - used, "\\u%04x", c);
+                else if(!json && c == '"')
+                        used += snprintf(out + used, len - used, "\"\"");
+                else
+                        out[used++] = c;
+        }
+        out[used] = '\0';
+}
+
+/*
+ * Effective bandwidth: every element is read once and written once.
+ */
+static double
+bench_gbps(const struct bench_result *r)
+{
+        return (2.0 * sizeof(float) * r->count) / (r->median_ms * 1e-3) / 1e9;
+}
+
+static void
+bench_print_csv(FILE *out, const char *device, const char *driver, const struct bench_result *r)
+{
+        fprintf(out, "\"%s\",\"%s\",%lu,%lu,%u,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%.0f\n",
+                device, driver, (unsigned long)r->count, (unsigned long)(2 * sizeof(float) * r->count), r->trials,
+                r->median_ms, r->p95_ms, r->p99_ms, r->min_ms, r->in_ms, r->kernel_ms, r->out_ms,
+                bench_gbps(r), r->count / (r->median_ms * 1e-3));
+}
+
+static void
+bench_print_json(FILE *out, const struct bench_result *r, int first)
+{
+        fprintf(out, "%s    {\"count\": %lu, \"bytes\": %lu, \"trials\": %u, \"median_ms\": %.6f, \"p95_ms\": %.6f, "
+                "\"p99_ms\": %.6f, \"min_ms\": %.6f, \"in_ms\": %.6f, \"kernel_ms\": %.6f, \"out_ms\": %.6f, "
+                "\"gbps\": %.3f, \"elements_per_s\": %.0f}",
+                first ? "" : ",\n", (unsigned long)r->count, (unsigned long)(2 * sizeof(float) * r->count), r->trials,
+                r->median_ms, r->p95_ms, r->p99_ms, r->min_ms, r->in_ms, r->kernel_ms, r->out_ms,
+                bench_gbps(r), r->count / (r->median_ms * 1e-3));
+}
+
+/*
+ * Runs every transpose variant once on matrices that are not a multiple of
+ * any tile, with row pitches wider than the rows, alpha and beta, and
+ * compares all of C with the host. Returns 0 if any element is off.
+ */
+static int
+bench_sgemm_check(struct ocl_runtime *rt)
+{
+        const size_t m = 37, n = 29, k = 43, pad = 3;
+        const float alpha = 1.5f, beta = 0.5f;
+        size_t lda_max = ((m > k) ? m : k) + pad, ldb_max = ((n > k) ? n : k) + pad, ldc = n + pad;
+        size_t a_size = sizeof(float) * lda_max * lda_max, b_size = sizeof(float) * ldb_max * ldb_max;
+        size_t c_size = sizeof(float) * m * ldc;
+        float *a = host_alloc(a_size), *b = host_alloc(b_size), *c = host_alloc(c_size), *result = host_alloc(c_size);
+        cl_mem a_mem, b_mem, c_mem;
+        cl_int err;
+        int ok = 1;
+
+        for(size_t i = 0; i < a_size / sizeof(float); i++)
+                a[i] = (float) (rand() / (float)RAND_MAX);
+        for(size_t i = 0; i < b_size / sizeof(float); i++)
+                b[i] = (float) (rand() / (float)RAND_MAX);
+        for(size_t i = 0; i < c_size / sizeof(float); i++)
+                c[i] = (float) (rand() / (float)RAND_MAX);
+
+        a_mem = bufpool_acquire(&rt->pool, CL_MEM_READ_ONLY, a_size);
+        b_mem = bufpool_acquire(&rt->pool, CL_MEM_READ_ONLY, b_size);
+        c_mem = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, c_size);
+        err  = clEnqueueWriteBuffer(rt->queue, a_mem, CL_FALSE, 0, a_size, a, 0, NULL, NULL);
+        err |= clEnqueueWriteBuffer(rt->queue, b_mem, CL_FALSE, 0, b_size, b, 0, NULL, NULL);
+	ocl_error("Uploading matrices", err);
+
+        for(int variant = 0; variant < 4; variant++) {
+                int trans_a = variant & 1, trans_b = variant >> 1;
+                size_t lda = (trans_a ? m : k) + pad, ldb = (trans_b ? k : n) + pad;
+                size_t wrong = 0;
+
+                err  = clEnqueueWriteBuffer(rt->queue, c_mem, CL_FALSE, 0, c_size, c, 0, NULL, NULL);
+		ocl_error("Uploading matrices", err);
+                sgemm_run(rt, trans_a, trans_b, m, n, k, alpha, a_mem, lda, b_mem, ldb, beta, c_mem, ldc);
+                err = clEnqueueReadBuffer(rt->queue, c_mem, CL_TRUE, 0, c_size, result, 0, NULL, NULL);
+		ocl_error("Reading result matrix", err);
+
+                for(size_t row = 0; row < m; row++) {
+                        for(size_t col = 0; col < n; col++) {
+                                double expected = beta * (double)c[row * ldc + col];
+                                double sum = 0.0;
+                                for(size_t i = 0; i < k; i++)
+                                        sum += (double)(trans_a ? a[i * lda + row] : a[row * lda + i]) *
+                                               (trans_b ? b[col * ldb + i] : b[i * ldb + col]);
+                                expected += alpha * sum;
+                                if(fabs(result[row * ldc + col] - expected) > 1e-4 * fabs(expected) + 1e-4)
+                                        wrong++;
+                        }
+                }
+                if(wrong > 0) {
+                        fprintf(stderr, "sgemm %s%s %lux%lux%lu: %lu of %lu elements are wrong\n",
+                                trans_a ? "T" : "N", trans_b ? "T" : "N", (unsigned long)m, (unsigned long)n,
+                                (unsigned long)k, (unsigned long)wrong, (unsigned long)(m * n));
+                        ok = 0;
+                }
+        }
+
+        bufpool_release(&rt->pool, a_mem);
+        bufpool_release(&rt->pool, b_mem);
+        bufpool_release(&rt->pool, c_mem);
+        free(a);
+        free(b);
+        free(c);
+        free(result);
+        return ok;
+}
+
+/*
+ * Times 'n' x 'n' x 'n' matrix multiplies, and checks two elements of the
+ * result against the host so a broken kernel does not report a fast time.
+ * Returns 0 if they are off, and the timings must then be discarded.
+ */
+static int
+bench_sgemm_size(struct ocl_runtime *rt, size_t n, unsigned int warmup, unsigned int trials,
+                 struct bench_sgemm_result *result)
+{
+        cl_int err;
+        size_t size = sizeof(float) * n * n;
+        float *a = host_alloc(size), *b = host_alloc(size), *c = host_alloc(size);
+        double *times = malloc(sizeof(double) * trials);
+        cl_mem a_mem, b_mem, c_mem;
+        int ok = 1;
+
+        if(times == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(1);
+        }
+        for(size_t i = 0; i < n * n; i++) {
+                a[i] = (float) (rand() / (float)RAND_MAX);
+                b[i] = (float) (rand() / (float)RAND_MAX);
+        }
+
+        a_mem = bufpool_acquire(&rt->pool, CL_MEM_READ_ONLY, size);
+        b_mem = bufpool_acquire(&rt->pool, CL_MEM_READ_ONLY, size);
+        c_mem = bufpool_acquire(&rt->pool, CL_MEM_WRITE_ONLY, size);
+        err  = clEnqueueWriteBuffer(rt->queue, a_mem, CL_FALSE, 0, size, a, 0, NULL, NULL);
+        err |= clEnqueueWriteBuffer(rt->queue, b_mem, CL_FALSE, 0, size, b, 0, NULL, NULL);
+        err |= clFinish(rt->queue);
+	ocl_error("Uploading matrices", err);
+
+        for(unsigned int i = 0; i < warmup + trials; i++) {
+                double t0 = time_seconds();
+                sgemm_run(rt, 0, 0, n, n, n, 1.0f, a_mem, n, b_mem, n, 0.0f, c_mem, n);
+                err = clFinish(rt->queue);
+		ocl_error("Running sgemm", err);
+                if(i >= warmup)
+                        times[i - warmup] = (time_seconds() - t0) * 1e3;
+        }
+
+        err = clEnqueueReadBuffer(rt->queue, c_mem, CL_TRUE, 0, size, c, 0, NULL, NULL);
+	ocl_error("Reading result matrix", err);
+        for(size_t corner = 0; corner < 2; corner++) {
+                size_t row = corner * (n - 1), col = corner * (n - 1);
+                double expected = 0.0;
+                for(size_t k = 0; k < n; k++)
+                        expected += (double)a[row * n + k] * b[k * n + col];
+                if(fabs(c[row * n + col] - expected) > 1e-3 * expected + 1e-3) {
+                        fprintf(stderr, "sgemm %lu: C[%lu][%lu] is %f, expected %f\n", (unsigned long)n,
+                                (unsigned long)row, (unsigned long)col, c[row * n + col], expected);
+                        ok = 0;
+                }
+        }
+
+        bufpool_release(&rt->pool, a_mem);
+        bufpool_release(&rt->pool, b_mem);
+        bufpool_release(&rt->pool, c_mem);
+
+        result->n = n;
+        result->trials = trials;
+        result->median_ms = median_of(times, trials);
+        result->p95_ms = percentile(times, trials, 0.95);
+        result->min_ms = times[0];
+        result->gflops = 2.0 * n * n * n / (result->median_ms * 1e-3) / 1e9;
+        free(times);
+        free(a);
+        free(b);
+        free(c);
+        return ok;
+}
+
+static void
+bench_print_sgemm(FILE *out, int json, int first, const char *device, const char *driver,
+                  const struct bench_sgemm_result *r, double peak)
+{
+        if(json)
+                fprintf(out, "%s    {\"n\": %lu, \"trials\": %u, \"median_ms\": %.6f, \"p95_ms\": %.6f, "
+                        "\"min_ms\": %.6f, \"gflops\": %.3f, \"peak_gflops\": %.3f, \"percent_of_peak\": %.2f}",
+                        first ? "" : ",\n", (unsigned long)r->n, r->trials, r->median_ms, r->p95_ms, r->min_ms,
+                        r->gflops, peak, 100.0 * r->gflops / peak);
+        else
+                fprintf(out, "\"%s\",\"%s\",%lu,%u,%.6f,%.6f,%.6f,%.3f,%.3f,%.2f\n", device, driver,
+                        (unsigned long)r->n, r->trials, r->median_ms, r->p95_ms, r->min_ms,
+                        r->gflops, peak, 100.0 * r->gflops / peak);
+}
+
+/*
+ * SGEMM sweep over square matrices of dimension 'min' to 'max', after a
+ * check of every transpose variant. Sizes whose result is wrong are left
+ * out. 'device' and 'driver' are already escaped for the output format.
+ * Returns 0 if any check failed.
+ */
+static int
+bench_sgemm(struct ocl_runtime *rt, FILE *out, int json, const char *device, const char *driver,
+            size_t min, size_t max, unsigned int step, unsigned int warmup, unsigned int trials)
+{
+        struct bench_sgemm_result result;
+        double peak = sgemm_peak_gflops(rt);
+        cl_ulong max_alloc;
+        cl_int err;
+        int ok = bench_sgemm_check(rt);
+
+        err = clGetDeviceInfo(rt->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL);
+	ocl_error("Unable to get device info", err);
+
+        if(json)
+                fprintf(out, "{\n  \"device\": \"%s\",\n  \"driver\": \"%s\",\n  \"results\": [\n", device, driver);
+        else
+                fprintf(out, "device,driver,n,trials,median_ms,p95_ms,min_ms,gflops,peak_gflops,percent_of_peak\n");
+
+        for(size_t n = min, done = 0; n <= max; n *= step) {
+                if(sizeof(float) * n * n > max_alloc) {
+                        fprintf(stderr, "Skipping %lu x %lu, larger than one device allocation\n",
+                                (unsigned long)n, (unsigned long)n);
+                        continue;
+                }
+                if(!bench_sgemm_size(rt, n, warmup, trials, &result)) {
+                        ok = 0;
+                        continue;
+                }
+                bench_print_sgemm(out, json, done++ == 0, device, driver, &result, peak);
+                fflush(out);
+        }
+        if(json)
+                fprintf(out, "\n  ]\n}\n");
+        return ok;
+}
+
+int main(int argc, char **argv)
+{
+        struct ocl_runtime rt;
+        struct bench_result result;
+        size_t min = 0, max = 0;
+        unsigned int step = 0;
+        int sgemm = 0;
+        unsigned int warmup = BENCH_WARMUP, trials = BENCH_TRIALS;
+        int json = 0;
+        const char *output = NULL;
+        char device[256] = "host", driver[256] = "";
+        char device_field[6 * sizeof(device)], driver_field[6 * sizeof(driver)];	// escaped for the output
+        float *data, *results;
+        FILE *out = stdout;
+        cl_ulong max_alloc = (cl_ulong)-1;
+        cl_ulong global_mem = (cl_ulong)-1;
+
+        for(int arg = 1; arg < argc; arg++) {
+                if(strcmp(argv[arg], "-sgemm") == 0) {
+                        sgemm = 1;
+                } else if(strcmp(argv[arg], "-min") == 0 && arg + 1 < argc) {
+                        min = strtoull(argv[++arg], NULL, 0);
+                } else if(strcmp(argv[arg], "-max") == 0 && arg + 1 < argc) {
+                        max = strtoull(argv[++arg], NULL, 0);
+                } else if(strcmp(argv[arg], "-step") == 0 && arg + 1 < argc) {
+                        step = strtoul(argv[++arg], NULL, 0);
+                } else if(strcmp(argv[arg], "-warmup") == 0 && arg + 1 < argc) {
+                        warmup = strtoul(argv[++arg], NULL, 0);
+                } else if(strcmp(argv[arg], "-trials") == 0 && arg + 1 < argc) {
+                        trials = strtoul(argv[++arg], NULL, 0);
+                } else if(strcmp(argv[arg], "-json") == 0) {
+                        json = 1;
+                } else if(strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+                        output = argv[++arg];
+                } else {
+                        usage(argv[0]);
+                        return EXIT_FAILURE;
+                }
+        }
+        // Unset sizes default to those of the chosen benchmark
+        if(min == 0)
+                min = sgemm ? BENCH_SGEMM_MIN : BENCH_MIN;
+        if(max == 0)
+                max = sgemm ? BENCH_SGEMM_MAX : BENCH_MAX;
+        if(step == 0)
+                step = sgemm ? BENCH_SGEMM_STEP : BENCH_STEP;
+        if(max < min || step < 2 || trials == 0) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        setup_opencl(&rt, OPENCL_PROFILING);
+        if(rt.host_fallback) {
+                snprintf(device, sizeof(device), "host %s x%u", host_isa_name(host_isa()), host_threads());
+        } else {
+                cl_int err;
+                err  = clGetDeviceInfo(rt.device, CL_DEVICE_NAME, sizeof(device), device, NULL);
+                err |= clGetDeviceInfo(rt.device, CL_DRIVER_VERSION, sizeof(driver), driver, NULL);
+                err |= clGetDeviceInfo(rt.device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL);
+                err |= clGetDeviceInfo(rt.device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(global_mem), &global_mem, NULL);
+		ocl_error("Unable to get device info", err);
+        }
+
+        if(output != NULL && (out = fopen(output, "w")) == NULL) {
+                fprintf(stderr, "Error: Unable to open %s for writing\n", output);
+                exit(1);
+        }
+        bench_escape(device, device_field, sizeof(device_field), json);
+        bench_escape(driver, driver_field, sizeof(driver_field), json);
+
+        if(sgemm) {
+                if(rt.host_fallback) {
+                        fprintf(stderr, "Error: The sgemm benchmark needs an OpenCL device\n");
+                        exit(1);
+                }
+                int ok = bench_sgemm(&rt, out, json, device_field, driver_field, min, max, step, warmup, trials);
+                if(out != stdout)
+                        fclose(out);
+                destroy_opencl(&rt);
+                return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if(json)
+                fprintf(out, "{\n  \"device\": \"%s\",\n  \"driver\": \"%s\",\n  \"results\": [\n", device_field,
+                        driver_field);
+        else
+                fprintf(out, "device,driver,count,bytes,trials,median_ms,p95_ms,p99_ms,min_ms,"
+                        "in_ms,kernel_ms,out_ms,gbps,elements_per_s\n");
+
+        data = host_alloc(sizeof(float) * max);
+        results = host_alloc(sizeof(float) * max);
+        for(size_t i = 0; i < max; i++)
+                data[i] = (float) (rand() / (float)RAND_MAX);
+
+        for(size_t count = min, done = 0; count <= max; count *= step) {
+                // Larger sizes are split over several buffers, but input and output must be resident
+                if(2 * sizeof(float) * count > global_mem) {
+                        fprintf(stderr, "Skipping %lu elements, input and output exceed device memory\n",
+                                (unsigned long)count);
+                        continue;
+                }
+                bench_size(&rt, count, max_alloc, warmup, trials, data, results, &result);
+                if(json)
+                        bench_print_json(out, &result, done++ == 0);
+                else
+                        bench_print_csv(out, device_field, driver_field, &result);
+                fflush(out);
+        }
+        if(json)
+                fprintf(out, "\n  ]\n}\n");
+
+        if(out != stdout)
+                fclose(out);
+        free(data);
+        free(results);
+        destroy_opencl(&rt);
+        return EXIT_SUCCESS;
+}
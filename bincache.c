@@ -0,0 +1,197 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bincache.h"
+#include "hash.h"
+#include "util.h"
+
+#define BINCACHE_MAGIC (0x424c434fU)	// "OCLB"
+
+struct bincache_header {
+        uint32_t magic;
+        uint32_t reserved;
+        uint64_t key;
+        uint64_t size;
+};
+
+
+/*
+ * Hash of everything that can change the compiled binary: the source (given
+ * by its hash), the build options, the device, its driver and the platform it
+ * belongs to.
+ */
+static uint64_t
+bincache_key(cl_device_id device, uint64_t source_hash, const char *options)
+{
+        cl_int err;
+        cl_platform_id platform;
+        char info[1024];
+        uint64_t key;
+
+        key = hash_bytes(&source_hash, sizeof(source_hash), HASH_SEED);
+        key = hash_string(options, key);
+
+        err  = clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(info), info, NULL);
+        key  = hash_string(info, key);
+        err |= clGetDeviceInfo(device, CL_DEVICE_VERSION, sizeof(info), info, NULL);
+        key  = hash_string(info, key);
+        err |= clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(info), info, NULL);
+        key  = hash_string(info, key);
+        err |= clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+	ocl_error("Unable to get device info", err);
+
+        err  = clGetPlatformInfo(platform, CL_PLATFORM_NAME, sizeof(info), info, NULL);
+        key  = hash_string(info, key);
+        err |= clGetPlatformInfo(platform, CL_PLATFORM_VERSION, sizeof(info), info, NULL);
+        key  = hash_string(info, key);
+	ocl_error("Getting platform info", err);
+
+        return key;
+}
+
+/*
+ * Builds 'program' for 'device'. Prints the build log and exits if the build
+ * fails and 'fatal' is set, otherwise returns the error code.
+ */
+static cl_int
+bincache_build(cl_program program, cl_device_id device, const char *options, int fatal)
+{
+        cl_int err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+        if (err != CL_SUCCESS && fatal) {
+                char* build_log;
+                size_t log_size;
+                // First call to know the proper size
+                clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+                build_log = malloc(sizeof(char)*(log_size+1));
+                if(log_size > 0 && build_log != NULL) {
+	                // Second call to get the log
+	                clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, build_log, NULL);
+	                build_log[log_size] = '\0';
+	                fprintf(stderr, "%s\n", build_log);
+                }
+                free(build_log);
+
+                exit(err);
+        }
+        return err;
+}
+
+/*
+ * Returns the cached binary stored under 'key', or NULL on a miss.
+ */
+static unsigned char *
+bincache_load(const char *path, uint64_t key, size_t *size)
+{
+        struct bincache_header header;
+        unsigned char *binary;
+        FILE *f = fopen(path, "rb");
+
+        if(f == NULL)
+                return NULL;
+
+        if(fread(&header, sizeof(header), 1, f) != 1 || header.magic != BINCACHE_MAGIC ||
+           header.key != key || header.size == 0) {
+                fclose(f);
+                return NULL;
+        }
+
+        binary = malloc(header.size);
+        if(binary == NULL || fread(binary, 1, header.size, f) != header.size) {
+                free(binary);
+                fclose(f);
+                return NULL;
+        }
+        fclose(f);
+
+        *size = header.size;
+        return binary;
+}
+
+/*
+ * Stores the binary of a freshly built program. The file is written under a
+ * temporary name and renamed into place, so concurrent workers never see a
+ * partially written entry.
+ */
+static void
+bincache_store(const char *path, uint64_t key, cl_program program)
+{
+        struct bincache_header header;
+        char tmp_path[1024 + 32];
+        unsigned char *binary;
+        size_t size;
+        FILE *f;
+
+        if(clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS || size == 0)
+                return;
+        binary = malloc(size);
+        if(binary == NULL)
+                return;
+        if(clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL) != CL_SUCCESS) {
+                free(binary);
+                return;
+        }
+
+        snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+        f = fopen(tmp_path, "wb");
+        if(f != NULL) {
+                header.magic = BINCACHE_MAGIC;
+                header.reserved = 0;
+                header.key = key;
+                header.size = size;
+                if(fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(binary, 1, size, f) == size) {
+                        fclose(f);
+                        rename(tmp_path, path);
+                } else {
+                        fclose(f);
+                        remove(tmp_path);
+                }
+        }
+        free(binary);
+}
+
+cl_program
+bincache_build_program(cl_context context, cl_device_id device, const char *source, size_t source_len,
+                       uint64_t source_hash, const char *options)
+{
+        cl_int err;
+        cl_program program;
+        char name[64];
+        char path[1024];
+        uint64_t key = bincache_key(device, source_hash, options);
+        int cached;
+
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        cached = cache_path(name, path, sizeof(path));
+
+        // Hit: load the binary, which still needs a (cheap) clBuildProgram
+        if(cached) {
+                size_t size = 0;
+                unsigned char *binary = bincache_load(path, key, &size);
+                if(binary != NULL) {
+                        cl_int status;
+                        program = clCreateProgramWithBinary(context, 1, &device, &size,
+                                                            (const unsigned char **) &binary, &status, &err);
+                        free(binary);
+                        if(err == CL_SUCCESS && status == CL_SUCCESS &&
+                           bincache_build(program, device, options, 0) == CL_SUCCESS)
+                                return program;
+                        if(err == CL_SUCCESS)
+                                clReleaseProgram(program);
+                        // Stale or rejected entry, rebuild and overwrite it below
+                }
+        }
+
+        // Miss: build from source
+        program = clCreateProgramWithSource(context, 1, &source, &source_len, &err);
+	ocl_error("Failed to create compute program", err);
+        bincache_build(program, device, options, 1);
+
+        if(cached)
+                bincache_store(path, key, program);
+
+        return program;
+}
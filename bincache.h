@@ -0,0 +1,19 @@
+#ifndef BINCACHE_H
+#define BINCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CL/cl.h"
+
+/*
+ * Returns a built program for 'device'. The binary is loaded from the on-disk
+ * cache when the source, options, device, driver and platform all match a
+ * previous build, otherwise it is compiled from source and stored.
+ * 'source_hash' is hash_bytes(source, source_len, HASH_SEED), which embedded
+ * sources have precomputed.
+ */
+cl_program bincache_build_program(cl_context context, cl_device_id device, const char *source, size_t source_len,
+                                  uint64_t source_hash, const char *options);
+
+#endif //BINCACHE_H
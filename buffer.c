@@ -0,0 +1,152 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "util.h"
+
+
+/*
+ * Page-aligned host memory, which lets drivers pin or share it without an
+ * extra bounce copy.
+ */
+void *
+host_alloc(size_t size)
+{
+        void *ptr = NULL;
+        long page = sysconf(_SC_PAGESIZE);
+
+        if(page <= 0)
+                page = 4096;
+        size = (size + page - 1) / page * page;
+        if(posix_memalign(&ptr, page, (size > 0) ? size : (size_t)page) != 0) {
+                printf("Error: Unable to allocate %lu bytes of host memory\n", (unsigned long)size);
+                exit(1);
+        }
+        return ptr;
+}
+
+/*
+ * Creates a buffer of 'size' bytes. On devices sharing memory with the host
+ * the buffer is host-visible (CL_MEM_ALLOC_HOST_PTR) and accessed through
+ * map/unmap, elsewhere it lives in device memory and is accessed through a
+ * page-aligned staging copy. The device memory comes from the runtime's pool.
+ */
+void
+buffer_create(struct ocl_runtime *rt, struct ocl_buffer *buf, cl_mem_flags flags, size_t size)
+{
+        memset(buf, 0, sizeof(*buf));
+        buf->size = size;
+        buf->zero_copy = rt->unified_memory;
+        if(buf->zero_copy)
+                flags |= CL_MEM_ALLOC_HOST_PTR;
+        buf->flags = flags;
+
+        buf->mem = bufpool_acquire(&rt->pool, flags, size);
+        buf->pooled = 1;
+}
+
+/*
+ * Creates a buffer around caller-owned host memory, which must stay valid
+ * until buffer_release(). On unified-memory devices the memory is used in
+ * place (CL_MEM_USE_HOST_PTR, best if page-aligned), elsewhere a pooled
+ * buffer is filled with one profiled write, recorded under 'label'.
+ */
+void
+buffer_wrap(struct ocl_runtime *rt, struct ocl_buffer *buf, cl_mem_flags flags, void *host, size_t size,
+            const char *label)
+{
+        cl_int err;
+        cl_event event;
+
+        memset(buf, 0, sizeof(*buf));
+        buf->size = size;
+        buf->zero_copy = rt->unified_memory;
+        if(buf->zero_copy) {
+                buf->flags = flags | CL_MEM_USE_HOST_PTR;
+                buf->mem = clCreateBuffer(rt->context, buf->flags, size, host, &err);
+		ocl_error("Wrapping host memory in device buffer", err);
+                return;
+        }
+
+        buf->flags = flags;
+        buf->mem = bufpool_acquire(&rt->pool, flags, size);
+        buf->pooled = 1;
+        err = clEnqueueWriteBuffer(rt->queue, buf->mem, CL_TRUE, 0, size, host, 0, NULL, &event);
+	ocl_error("Writing buffer", err);
+        profile_event(&rt->profile, event, label);
+        clReleaseEvent(event);
+}
+
+/*
+ * Returns a host pointer to the buffer contents, valid until buffer_unmap().
+ * With CL_MAP_READ the pointer holds the current device contents, with
+ * CL_MAP_WRITE whatever is written to it reaches the device on unmap.
+ */
+void *
+buffer_map(struct ocl_runtime *rt, struct ocl_buffer *buf, cl_map_flags map_flags)
+{
+        cl_int err;
+        cl_event event;
+
+        if(buf->zero_copy) {
+                buf->host = clEnqueueMapBuffer(rt->queue, buf->mem, CL_TRUE, map_flags, 0, buf->size,
+                                               0, NULL, &event, &err);
+		ocl_error("Mapping buffer", err);
+        } else {
+                if(buf->host == NULL)
+                        buf->host = host_alloc(buf->size);
+                if(map_flags & CL_MAP_READ) {
+                        err = clEnqueueReadBuffer(rt->queue, buf->mem, CL_TRUE, 0, buf->size, buf->host,
+                                                  0, NULL, &event);
+			ocl_error("Reading buffer", err);
+                } else {
+                        event = NULL;
+                }
+        }
+
+        if(event != NULL) {
+                profile_event(&rt->profile, event, NULL);
+                clReleaseEvent(event);
+        }
+        buf->map_flags = map_flags;
+        return buf->host;
+}
+
+void
+buffer_unmap(struct ocl_runtime *rt, struct ocl_buffer *buf)
+{
+        cl_int err;
+        cl_event event = NULL;
+
+        if(buf->zero_copy) {
+                err = clEnqueueUnmapMemObject(rt->queue, buf->mem, buf->host, 0, NULL, &event);
+		ocl_error("Unmapping buffer", err);
+                buf->host = NULL;
+        } else if(buf->map_flags & CL_MAP_WRITE) {
+                err = clEnqueueWriteBuffer(rt->queue, buf->mem, CL_TRUE, 0, buf->size, buf->host,
+                                           0, NULL, &event);
+		ocl_error("Writing buffer", err);
+        }
+
+        if(event != NULL) {
+                profile_event(&rt->profile, event, NULL);
+                clReleaseEvent(event);
+        }
+        buf->map_flags = 0;
+}
+
+void
+buffer_release(struct ocl_runtime *rt, struct ocl_buffer *buf)
+{
+        if(buf->mem != NULL && buf->pooled)
+                bufpool_release(&rt->pool, buf->mem);
+        else if(buf->mem != NULL)
+                clReleaseMemObject(buf->mem);
+        if(!buf->zero_copy)
+                free(buf->host);
+        memset(buf, 0, sizeof(*buf));
+}
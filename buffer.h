@@ -0,0 +1,32 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+/*
+ * A device buffer with a host view. Zero-copy on unified-memory devices,
+ * explicit copies through a staging area otherwise.
+ */
+struct ocl_buffer {
+        cl_mem mem;
+        size_t size;
+        cl_mem_flags flags;
+        int zero_copy;
+        int pooled;			// 'mem' goes back to the runtime's pool
+        void *host;			// mapped pointer or staging copy
+        cl_map_flags map_flags;		// flags of the current mapping
+};
+
+void *host_alloc(size_t size);
+void buffer_create(struct ocl_runtime *rt, struct ocl_buffer *buf, cl_mem_flags flags, size_t size);
+void buffer_wrap(struct ocl_runtime *rt, struct ocl_buffer *buf, cl_mem_flags flags, void *host, size_t size,
+                 const char *label);
+void *buffer_map(struct ocl_runtime *rt, struct ocl_buffer *buf, cl_map_flags map_flags);
+void buffer_unmap(struct ocl_runtime *rt, struct ocl_buffer *buf);
+void buffer_release(struct ocl_runtime *rt, struct ocl_buffer *buf);
+
+#endif //BUFFER_H
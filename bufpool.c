@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bufpool.h"
+#include "util.h"
+
+#define BUFPOOL_MIN_CLASS (8)			// smallest class holds 256 bytes
+#define BUFPOOL_UNPOOLED_FLAGS (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR)
+
+
+/*
+ * Index of the smallest power-of-two class holding 'size' bytes.
+ */
+static unsigned int
+bufpool_class(size_t size)
+{
+        unsigned int c = BUFPOOL_MIN_CLASS;
+
+        while(c < BUFPOOL_CLASSES - 1 && ((size_t)1 << c) < size)
+                c++;
+        return c;
+}
+
+/*
+ * 'limit' is the most memory kept cached in free lists; 0 uses half of the
+ * device's global memory.
+ */
+void
+bufpool_init(struct bufpool *pool, cl_context context, cl_device_id device, size_t limit)
+{
+        cl_int err;
+        cl_ulong global_mem;
+        cl_ulong max_alloc;
+
+        memset(pool, 0, sizeof(*pool));
+        pool->context = context;
+
+        err  = clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(global_mem), &global_mem, NULL);
+        err |= clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL);
+	ocl_error("Unable to get device info", err);
+
+        pool->max_alloc = max_alloc;
+        pool->limit = (limit > 0) ? limit : global_mem / 2;
+}
+
+/*
+ * Releases every cached buffer. Buffers still handed out stay valid.
+ */
+void
+bufpool_destroy(struct bufpool *pool)
+{
+        bufpool_trim(pool, 0);
+}
+
+/*
+ * Removes and returns a cached buffer of class 'c' that fits, or NULL.
+ */
+static cl_mem
+bufpool_take(struct bufpool *pool, unsigned int c, cl_mem_flags flags, size_t size)
+{
+        for(struct bufpool_entry **link = &pool->free[c]; *link != NULL; link = &(*link)->next) {
+                struct bufpool_entry *entry = *link;
+                cl_mem mem = entry->mem;
+                if(entry->flags != flags || entry->size < size)
+                        continue;
+
+                *link = entry->next;
+                pool->cached_bytes -= entry->size;
+                pool->in_use_bytes += entry->size;
+                free(entry);
+                return mem;
+        }
+        return NULL;
+}
+
+/*
+ * Returns a buffer of at least 'size' bytes with exactly 'flags', reusing a
+ * released one of the same size class when possible. If the driver runs out
+ * of memory the cache is emptied and the allocation retried once.
+ */
+cl_mem
+bufpool_acquire(struct bufpool *pool, cl_mem_flags flags, size_t size)
+{
+        cl_int err;
+        cl_mem mem;
+        unsigned int c = bufpool_class(size);
+        size_t alloc_size;
+
+        if(flags & BUFPOOL_UNPOOLED_FLAGS) {
+                printf("Error: Host pointer buffers can not be pooled\n");
+                exit(1);
+        }
+
+        mem = bufpool_take(pool, c, flags, size);
+        if(mem != NULL) {
+                pool->hits++;
+        } else {
+                // Round up to the class size unless that exceeds the largest allocation
+                alloc_size = (size_t)1 << c;
+                if(alloc_size > pool->max_alloc || alloc_size < size)
+                        alloc_size = size;
+
+                mem = clCreateBuffer(pool->context, flags, alloc_size, NULL, &err);
+                if(err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES ||
+                   err == CL_OUT_OF_HOST_MEMORY) {
+                        bufpool_trim(pool, 0);
+                        mem = clCreateBuffer(pool->context, flags, alloc_size, NULL, &err);
+                }
+		ocl_error("Allocating pooled device buffer", err);
+                pool->in_use_bytes += alloc_size;
+                pool->misses++;
+        }
+
+        if(pool->in_use_bytes > pool->high_water_bytes)
+                pool->high_water_bytes = pool->in_use_bytes;
+        return mem;
+}
+
+/*
+ * Returns 'mem' to the pool. The buffer is freed instead if keeping it would
+ * push the cache over its limit.
+ */
+void
+bufpool_release(struct bufpool *pool, cl_mem mem)
+{
+        cl_int err;
+        size_t size;
+        cl_mem_flags flags;
+        struct bufpool_entry *entry;
+
+        err  = clGetMemObjectInfo(mem, CL_MEM_SIZE, sizeof(size), &size, NULL);
+        err |= clGetMemObjectInfo(mem, CL_MEM_FLAGS, sizeof(flags), &flags, NULL);
+	ocl_error("Getting buffer info", err);
+
+        pool->in_use_bytes -= size;
+
+        if(pool->cached_bytes + size > pool->limit || (entry = malloc(sizeof(*entry))) == NULL) {
+                clReleaseMemObject(mem);
+                pool->trimmed_bytes += size;
+                return;
+        }
+
+        unsigned int c = bufpool_class(size);
+        entry->mem = mem;
+        entry->flags = flags;
+        entry->size = size;
+        entry->next = pool->free[c];
+        pool->free[c] = entry;
+        pool->cached_bytes += size;
+}
+
+/*
+ * Frees cached buffers, largest classes first, until at most 'keep' bytes
+ * remain cached. Call on memory pressure; bufpool_trim(pool, 0) empties the
+ * cache.
+ */
+void
+bufpool_trim(struct bufpool *pool, size_t keep)
+{
+        for(int c = BUFPOOL_CLASSES - 1; c >= 0 && pool->cached_bytes > keep; c--) {
+                while(pool->free[c] != NULL && pool->cached_bytes > keep) {
+                        struct bufpool_entry *entry = pool->free[c];
+                        pool->free[c] = entry->next;
+                        pool->cached_bytes -= entry->size;
+                        pool->trimmed_bytes += entry->size;
+                        clReleaseMemObject(entry->mem);
+                        free(entry);
+                }
+        }
+}
+
+void
+bufpool_print(const struct bufpool *pool, FILE *out)
+{
+        fprintf(out, "Buffer pool: %lu hits, %lu misses, in use %.2fMB, high-water %.2fMB, "
+                "cached %.2fMB, trimmed %.2fMB\n",
+                (unsigned long)pool->hits, (unsigned long)pool->misses,
+                pool->in_use_bytes / (1024.0 * 1024.0), pool->high_water_bytes / (1024.0 * 1024.0),
+                pool->cached_bytes / (1024.0 * 1024.0), pool->trimmed_bytes / (1024.0 * 1024.0));
+}
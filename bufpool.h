@@ -0,0 +1,41 @@
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "CL/cl.h"
+
+#define BUFPOOL_CLASSES (48)
+
+struct bufpool_entry {
+        cl_mem mem;
+        cl_mem_flags flags;
+        size_t size;
+        struct bufpool_entry *next;
+};
+
+/*
+ * Recycles device buffers of one context in power-of-two size classes.
+ */
+struct bufpool {
+        cl_context context;
+        size_t max_alloc;
+        size_t limit;				// most bytes kept in free lists
+        struct bufpool_entry *free[BUFPOOL_CLASSES];
+
+        size_t in_use_bytes;
+        size_t high_water_bytes;
+        size_t cached_bytes;
+        size_t trimmed_bytes;
+        size_t hits, misses;
+};
+
+void bufpool_init(struct bufpool *pool, cl_context context, cl_device_id device, size_t limit);
+void bufpool_destroy(struct bufpool *pool);
+cl_mem bufpool_acquire(struct bufpool *pool, cl_mem_flags flags, size_t size);
+void bufpool_release(struct bufpool *pool, cl_mem mem);
+void bufpool_trim(struct bufpool *pool, size_t keep);
+void bufpool_print(const struct bufpool *pool, FILE *out);
+
+#endif //BUFPOOL_H
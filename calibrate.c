@@ -0,0 +1,296 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bincache.h"
+#include "calibrate.h"
+#include "hash.h"
+#include "opencl.h"
+#include "source.h"
+#include "util.h"
+
+#define CALIBRATION_FILE "devices.txt"
+#define CALIBRATION_RUNS (3)
+#define CALIBRATION_MAX_ENTRIES (256)
+
+
+/*
+ * Key identifying a device on this host. The hostname is part of the key so
+ * that a cache directory shared between machines does not mix up results.
+ */
+static uint64_t
+calibration_key(cl_platform_id platform, cl_device_id device)
+{
+        char info[1024];
+        uint64_t key = HASH_SEED;
+
+        if(gethostname(info, sizeof(info)) == 0) {
+                info[sizeof(info) - 1] = '\0';
+                key = hash_string(info, key);
+        }
+        if(clGetPlatformInfo(platform, CL_PLATFORM_NAME, sizeof(info), info, NULL) == CL_SUCCESS)
+                key = hash_string(info, key);
+        if(clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(info), info, NULL) == CL_SUCCESS)
+                key = hash_string(info, key);
+        if(clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(info), info, NULL) == CL_SUCCESS)
+                key = hash_string(info, key);
+        return key;
+}
+
+static int
+calibration_load(uint64_t key, size_t count, struct calibration *result)
+{
+        char path[1024];
+        unsigned long long line_key;
+        unsigned long long line_count;
+        double transfer, kernel;
+        int found = 0;
+        FILE *f;
+
+        if(!cache_path(CALIBRATION_FILE, path, sizeof(path)) || (f = fopen(path, "r")) == NULL)
+                return 0;
+
+        // Later lines win, so a recalibrated device replaces its old entry
+        while(fscanf(f, "%llx %llu %lf %lf", &line_key, &line_count, &transfer, &kernel) == 4) {
+                if(line_key == key && line_count == count) {
+                        result->transfer_time = transfer;
+                        result->kernel_time = kernel;
+                        found = 1;
+                }
+        }
+        fclose(f);
+        return found;
+}
+
+/*
+ * Rewrites the cache with this result replacing any older entry for the same
+ * device and count. Only the CALIBRATION_MAX_ENTRIES most recent entries are
+ * kept, so the file stays small however many sizes get calibrated. The file
+ * is written under a temporary name and renamed into place.
+ */
+static void
+calibration_store(uint64_t key, size_t count, const struct calibration *result)
+{
+        struct calibration_entry {
+                unsigned long long key, count;
+                double transfer, kernel;
+        } *entries;
+        char path[1024];
+        char tmp_path[1024 + 32];
+        unsigned int num = 0, first = 0;
+        struct calibration_entry line;
+        FILE *f;
+
+        if(!cache_path(CALIBRATION_FILE, path, sizeof(path)))
+                return;
+        entries = malloc(sizeof(*entries) * CALIBRATION_MAX_ENTRIES);
+        if(entries == NULL)
+                return;
+
+        // Keep a ring of the newest other entries, oldest at 'first' once full
+        if((f = fopen(path, "r")) != NULL) {
+                while(fscanf(f, "%llx %llu %lf %lf", &line.key, &line.count, &line.transfer, &line.kernel) == 4) {
+                        if(line.key == key && line.count == count)
+                                continue;
+                        if(num < CALIBRATION_MAX_ENTRIES - 1) {
+                                entries[num++] = line;
+                        } else {
+                                entries[first] = line;
+                                first = (first + 1) % num;
+                        }
+                }
+                fclose(f);
+        }
+
+        snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+        f = fopen(tmp_path, "w");
+        if(f != NULL) {
+                for(unsigned int i = 0; i < num; i++) {
+                        const struct calibration_entry *e = &entries[(first + i) % num];
+                        fprintf(f, "%016llx %llu %.9g %.9g\n", e->key, e->count, e->transfer, e->kernel);
+                }
+                fprintf(f, "%016llx %llu %.9g %.9g\n", (unsigned long long)key, (unsigned long long)count,
+                        result->transfer_time, result->kernel_time);
+                if(fclose(f) == 0)
+                        rename(tmp_path, path);
+                else
+                        remove(tmp_path);
+        }
+        free(entries);
+}
+
+/*
+ * Number of elements a 'count' element calibration actually measures: the
+ * job is shrunk to the largest buffer the device can allocate. Returns 0 if
+ * the device could not be queried.
+ */
+static size_t
+calibration_count(cl_device_id device, size_t count)
+{
+        cl_ulong max_alloc;
+
+        if(clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL) != CL_SUCCESS)
+                return 0;
+        if(sizeof(float) * count > max_alloc)
+                count = max_alloc / sizeof(float);
+        return count;
+}
+
+/*
+ * Runs the calibration kernels on one device. Returns 0 if the device could
+ * not be used.
+ */
+static int
+calibration_run(cl_device_id device, size_t count, struct calibration *result)
+{
+        cl_int err;
+        cl_context context;
+        cl_command_queue queue;
+        cl_program program;
+        cl_kernel kernel;
+        cl_mem input, output = NULL;
+        cl_ulong n = count;
+        float *data;
+        int ok = 0;
+
+        data = malloc(sizeof(float) * count);
+        if(data == NULL)
+                return 0;
+        for(size_t i = 0; i < count; i++)
+                data[i] = (float) (rand() / (float)RAND_MAX);
+
+        context = clCreateContext(0, 1, &device, NULL, NULL, &err);
+        if(err != CL_SUCCESS) {
+                free(data);
+                return 0;
+        }
+        queue = clCreateCommandQueue(context, device, 0, &err);
+        if(err != CL_SUCCESS) {
+                clReleaseContext(context);
+                free(data);
+                return 0;
+        }
+
+        struct kernel_source cl_source;
+        if(!source_load("square.cl", &cl_source))
+                exit(1);
+        program = bincache_build_program(context, device, cl_source.data, cl_source.size, cl_source.hash, NULL);
+        source_release(&cl_source);
+        kernel = clCreateKernel(program, "square", &err);
+	ocl_error("Failed to create compute kernel", err);
+
+        input = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(float) * count, NULL, &err);
+        if(err == CL_SUCCESS)
+                output = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * count, NULL, &err);
+        if(err == CL_SUCCESS) {
+                err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
+                err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
+                err |= clSetKernelArg(kernel, 2, sizeof(cl_ulong), &n);
+        }
+
+        // The first run warms up the driver and is not counted, the rest keep the best time
+        result->transfer_time = result->kernel_time = 0.0;
+        for(int run = 0; err == CL_SUCCESS && run <= CALIBRATION_RUNS; run++) {
+                double t0, t1, t2, t3;
+
+                t0 = time_seconds();
+                err |= clEnqueueWriteBuffer(queue, input, CL_TRUE, 0, sizeof(float) * count, data, 0, NULL, NULL);
+                t1 = time_seconds();
+                err |= opencl_enqueue_range(queue, kernel, count, 0, 0, NULL, NULL);
+                err |= clFinish(queue);
+                t2 = time_seconds();
+                err |= clEnqueueReadBuffer(queue, output, CL_TRUE, 0, sizeof(float) * count, data, 0, NULL, NULL);
+                t3 = time_seconds();
+
+                if(run == 1 || (run > 1 && (t1 - t0) + (t3 - t2) < result->transfer_time))
+                        result->transfer_time = (t1 - t0) + (t3 - t2);
+                if(run == 1 || (run > 1 && t2 - t1 < result->kernel_time))
+                        result->kernel_time = t2 - t1;
+        }
+        ok = (err == CL_SUCCESS);
+
+        if(input != NULL)
+                clReleaseMemObject(input);
+        if(output != NULL)
+                clReleaseMemObject(output);
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
+        clReleaseCommandQueue(queue);
+        clReleaseContext(context);
+        free(data);
+        return ok;
+}
+
+int
+calibrate_device(cl_platform_id platform, cl_device_id device, size_t count, struct calibration *result)
+{
+        uint64_t key = calibration_key(platform, device);
+
+        // Cache and score by the measured size, not the requested one
+        count = calibration_count(device, count);
+        if(count == 0)
+                return 0;
+        result->count = count;
+        if(calibration_load(key, count, result)) {
+                result->cached = 1;
+                return 1;
+        }
+        if(!calibration_run(device, count, result))
+                return 0;
+        result->cached = 0;
+        calibration_store(key, count, result);
+        return 1;
+}
+
+double
+calibration_throughput(const struct calibration *result)
+{
+        double total = result->transfer_time + result->kernel_time;
+        return (total > 0.0) ? result->count / total : 0.0;
+}
+
+/*
+ * Same contract as get_best_device(), but ranks devices by the measured
+ * throughput of a 'count' element square job instead of a static score.
+ */
+int
+get_fastest_device(size_t count, unsigned int *ret_platform, unsigned int *ret_device)
+{
+	cl_int err = CL_SUCCESS;
+        double best_score = 0.0;
+
+        cl_platform_id platform[MAX_RESOURCES];
+        cl_uint num_platform;
+        cl_device_id devices[MAX_RESOURCES];
+        cl_uint num_devices;
+        cl_bool available;
+        struct calibration result;
+
+        num_platform = opencl_platforms(platform);
+
+        for(unsigned int i = 0; i < num_platform; i++) {
+                err = clGetDeviceIDs(platform[i], CL_DEVICE_TYPE_ALL, sizeof(devices), devices, &num_devices);
+		ocl_error("Getting device ids", err);
+
+                for(unsigned int j = 0; j < num_devices; ++j) {
+                        err = clGetDeviceInfo(devices[j], CL_DEVICE_AVAILABLE, sizeof(available), &available, NULL);
+			ocl_error("Unable to get device info", err);
+                        if(!available || !calibrate_device(platform[i], devices[j], count, &result))
+                                continue;
+
+                        double score = calibration_throughput(&result);
+                        printf("Platform-%d Device-%d\tTransfer: %.3fms\tKernel: %.3fms\t%.1f Melem/s%s\n",
+                               i, j, result.transfer_time * 1e3, result.kernel_time * 1e3, score / 1e6,
+                               (result.cached ? " (cached)" : ""));
+                        if(score > best_score) {
+                                best_score = score;
+                                *ret_platform = i;
+                                *ret_device = j;
+                        }
+                }
+        }
+        return (best_score > 0.0);
+}
@@ -0,0 +1,19 @@
+#ifndef CALIBRATE_H
+#define CALIBRATE_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+struct calibration {
+        size_t count;			// elements actually measured
+        double transfer_time;		// seconds for the write + read round-trip
+        double kernel_time;		// seconds for one square pass
+        int cached;			// loaded from the per-host cache
+};
+
+int calibrate_device(cl_platform_id platform, cl_device_id device, size_t count, struct calibration *result);
+double calibration_throughput(const struct calibration *result);
+int get_fastest_device(size_t count, unsigned int *ret_platform, unsigned int *ret_device);
+
+#endif //CALIBRATE_H
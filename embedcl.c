@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+
+/*
+ * Build tool: writes a C file to stdout that embeds every OpenCL source given
+ * on the command line, with its content hash, as the embedded_sources table
+ * declared in source.h.
+ *
+ *   ./embedcl square.cl other.cl > kernels_embedded.c
+ */
+
+static unsigned char *
+read_file(const char *filename, size_t *size)
+{
+        FILE *f = fopen(filename, "rb");
+        unsigned char *data = NULL;
+        size_t capacity = 0;
+        size_t n;
+
+        if(f == NULL) {
+                fprintf(stderr, "embedcl: Unable to open %s for reading\n", filename);
+                exit(1);
+        }
+
+        *size = 0;
+        do {
+                if(*size == capacity) {
+                        capacity = (capacity > 0) ? capacity * 2 : 65536;
+                        data = realloc(data, capacity);
+                        if(data == NULL) {
+                                fprintf(stderr, "embedcl: Out of memory reading %s\n", filename);
+                                exit(1);
+                        }
+                }
+                n = fread(data + *size, 1, capacity - *size, f);
+                *size += n;
+        } while(n > 0);
+
+        if(ferror(f)) {
+                fprintf(stderr, "embedcl: Unable to read %s\n", filename);
+                exit(1);
+        }
+        fclose(f);
+        return data;
+}
+
+/*
+ * The name a source is looked up by: its file name without directories.
+ */
+static const char *
+base_name(const char *path)
+{
+        const char *slash = strrchr(path, '/');
+        return (slash != NULL) ? slash + 1 : path;
+}
+
+int main(int argc, char **argv)
+{
+        if(argc < 2) {
+                fprintf(stderr, "Usage: %s file.cl... > kernels_embedded.c\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        printf("/* Generated by embedcl from the .cl files, do not edit. */\n\n");
+        printf("#include \"source.h\"\n\n");
+
+        for(int i = 1; i < argc; i++) {
+                size_t size;
+                unsigned char *data = read_file(argv[i], &size);
+
+                // An initializer list rather than a string literal, so no length limits apply
+                printf("static const char source_%d[] = {", i);
+                for(size_t j = 0; j < size; j++)
+                        printf("%s0x%02x,", (j % 12 == 0) ? "\n        " : " ", data[j]);
+                printf("%s0x00\n};\n\n", (size % 12 == 0) ? "\n        " : " ");
+                free(data);
+        }
+
+        printf("const struct embedded_source embedded_sources[] = {\n");
+        for(int i = 1; i < argc; i++) {
+                size_t size;
+                unsigned char *data = read_file(argv[i], &size);
+
+                printf("        { \"%s\", source_%d, %lu, 0x%016llxULL },\n", base_name(argv[i]), i,
+                       (unsigned long)size, (unsigned long long)hash_bytes(data, size, HASH_SEED));
+                free(data);
+        }
+        printf("};\n\n");
+        printf("const unsigned int num_embedded_sources = %d;\n", argc - 1);
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+#include "hash.h"
+#include "scan.h"
+#include "source.h"
+#include "specialize.h"
+#include "util.h"
+
+static const char *filter_type_names[FILTER_TYPE_COUNT] = { "int", "uint", "float" };
+
+
+/*
+ * Returns the kernel 'stage' for 'type' from filter.cl, built with the
+ * comparison 'op' compiled in.
+ */
+static cl_kernel
+filter_kernel(struct ocl_runtime *rt, const char *stage, enum filter_type type, enum filter_op op)
+{
+        char name[64];
+        struct specialization spec;
+
+        specialize_init(&spec, 0);
+        specialize_define(&spec, "FILTER_OP", op);
+        snprintf(name, sizeof(name), "filter_%s_%s", stage, filter_type_names[type]);
+        return specialize_kernel(rt, "filter.cl", &spec, name);
+}
+
+/*
+ * Returns filter.cl built with FILTER_PREDICATE(x) defined as 'predicate'.
+ * An expression does not fit a -D build option (it may hold spaces and
+ * parentheses), so it is prepended to the source instead. Each predicate is
+ * built once per runtime and cached on disk like any other program.
+ */
+static cl_program
+filter_predicate_program(struct ocl_runtime *rt, const char *predicate)
+{
+        struct kernel_source cl_source;
+        char name[64];
+        char *source;
+        size_t len;
+        cl_program program;
+
+        if(!source_load("filter.cl", &cl_source))
+                exit(1);
+
+        len = strlen("#define FILTER_PREDICATE(x) ()\n#line 1\n") + strlen(predicate) + cl_source.size;
+        source = malloc(len + 1);
+        if(source == NULL) {
+                printf("Error: Out of memory generating a filter predicate\n");
+                exit(1);
+        }
+        snprintf(source, len + 1, "#define FILTER_PREDICATE(x) (%s)\n#line 1\n", predicate);
+        memcpy(source + strlen(source), cl_source.data, cl_source.size);
+        source[len] = '\0';
+        source_release(&cl_source);
+
+        snprintf(name, sizeof(name), "filter-%016llx.cl", (unsigned long long)hash_bytes(source, len, HASH_SEED));
+        program = opencl_program_source(rt, name, source, len, NULL);
+        free(source);
+        return program;
+}
+
+/*
+ * Flags, scans and scatters: the passing elements of 'input' go to the start
+ * of 'output', their input indices to 'indices' if not NULL. Returns how
+ * many passed.
+ */
+static size_t
+filter_pipeline(struct ocl_runtime *rt, cl_kernel flag, cl_kernel scatter, const void *threshold,
+                cl_mem input, cl_mem output, cl_mem indices, size_t count)
+{
+        cl_int err;
+        cl_event event;
+        cl_ulong count_arg = count;
+        cl_uint with_indices = (indices != NULL);
+        cl_uint total;
+        cl_mem offsets;
+
+        if(count == 0)
+                return 0;
+        if(count > 0xffffffffUL) {
+                printf("Error: Unable to filter %lu elements, uint offsets hold fewer\n", (unsigned long)count);
+                exit(1);
+        }
+        if(indices == NULL)
+                indices = output;	// never written, but a kernel argument must be a buffer
+
+        offsets = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_uint) * count);
+
+        err  = clSetKernelArg(flag, 0, sizeof(cl_mem), &input);
+        err |= clSetKernelArg(flag, 1, sizeof(cl_mem), &offsets);
+        err |= clSetKernelArg(flag, 2, sizeof(cl_ulong), &count_arg);
+        err |= clSetKernelArg(flag, 3, sizeof(cl_uint), threshold);
+	ocl_error("Setting filter kernel arguments", err);
+        err = opencl_enqueue_range(rt->queue, flag, count, 0, 0, NULL, &event);
+	ocl_error("Enqueueing filter flags", err);
+        profile_event(&rt->profile, event, "filter flag");
+        clReleaseEvent(event);
+
+        // Flags become output offsets, their total is the number of matches
+        scan_run(rt, SCAN_UINT, SCAN_EXCLUSIVE, offsets, offsets, count, &total);
+
+        if(total > 0) {
+                err  = clSetKernelArg(scatter, 0, sizeof(cl_mem), &input);
+                err |= clSetKernelArg(scatter, 1, sizeof(cl_mem), &offsets);
+                err |= clSetKernelArg(scatter, 2, sizeof(cl_mem), &output);
+                err |= clSetKernelArg(scatter, 3, sizeof(cl_mem), &indices);
+                err |= clSetKernelArg(scatter, 4, sizeof(cl_ulong), &count_arg);
+                err |= clSetKernelArg(scatter, 5, sizeof(cl_uint), threshold);
+                err |= clSetKernelArg(scatter, 6, sizeof(cl_uint), &with_indices);
+		ocl_error("Setting filter kernel arguments", err);
+                err = opencl_enqueue_range(rt->queue, scatter, count, 0, 0, NULL, &event);
+		ocl_error("Enqueueing filter scatter", err);
+                profile_event(&rt->profile, event, "filter scatter");
+                clReleaseEvent(event);
+        }
+
+        bufpool_release(&rt->pool, offsets);
+        return total;
+}
+
+/*
+ * Copies the elements of the first 'count' int, uint or float elements of
+ * 'input' that compare as 'op' against '*threshold' (one element of 'type')
+ * to the start of 'output', densely packed and in input order, and returns
+ * how many there are. If 'indices' is not NULL, the input index of every
+ * copied element is stored at the same position as uints. 'output' and
+ * 'indices' must hold 'count' elements, only the returned number is written,
+ * so only that many need to be read back. 'count' must be below 2^32.
+ */
+size_t
+filter_run(struct ocl_runtime *rt, enum filter_type type, enum filter_op op, const void *threshold,
+           cl_mem input, cl_mem output, cl_mem indices, size_t count)
+{
+        return filter_pipeline(rt, filter_kernel(rt, "flag", type, op), filter_kernel(rt, "scatter", type, op),
+                               threshold, input, output, indices, count);
+}
+
+/*
+ * Like filter_run(), keeping the elements for which 'predicate', an OpenCL C
+ * expression of the element 'x' such as "x > 0.25f && x < 0.75f", is true.
+ * The predicate is compiled into its own variant of filter.cl; threshold
+ * comparisons are better served by filter_run(), which does not rebuild for
+ * a new threshold.
+ */
+size_t
+filter_predicate(struct ocl_runtime *rt, enum filter_type type, const char *predicate, cl_mem input, cl_mem output,
+                 cl_mem indices, size_t count)
+{
+        char name[64];
+        cl_program program = filter_predicate_program(rt, predicate);
+        cl_kernel flag, scatter;
+        cl_uint unused = 0;
+
+        snprintf(name, sizeof(name), "filter_flag_%s", filter_type_names[type]);
+        flag = opencl_program_kernel(rt, program, name);
+        snprintf(name, sizeof(name), "filter_scatter_%s", filter_type_names[type]);
+        scatter = opencl_program_kernel(rt, program, name);
+        if(flag == NULL || scatter == NULL) {
+                printf("Error: Kernel %s is not in filter.cl\n", name);
+                exit(1);
+        }
+        return filter_pipeline(rt, flag, scatter, &unused, input, output, indices, count);
+}
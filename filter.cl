@@ -0,0 +1,65 @@
+/*
+ * Stream compaction: filter_flag marks the elements passing the predicate,
+ * the marks are scanned into output offsets (scan.cl), and filter_scatter
+ * writes the passing elements densely packed, in input order.
+ *
+ * The comparison is chosen at build time with -D FILTER_OP, the threshold
+ * it compares against is a kernel argument. Alternatively FILTER_PREDICATE(x)
+ * is defined as any expression of the element, prepended to this source by
+ * filter.c, and the threshold is ignored.
+ */
+
+// Comparisons, must match enum filter_op in filter.h
+#define FILTER_LESS (0)
+#define FILTER_LESS_EQUAL (1)
+#define FILTER_GREATER (2)
+#define FILTER_GREATER_EQUAL (3)
+#define FILTER_EQUAL (4)
+#define FILTER_NOT_EQUAL (5)
+
+#ifndef FILTER_OP
+#define FILTER_OP FILTER_GREATER
+#endif
+
+#ifdef FILTER_PREDICATE
+#define FILTER_PASSES(x, t) FILTER_PREDICATE(x)
+#elif FILTER_OP == FILTER_LESS
+#define FILTER_PASSES(x, t) ((x) < (t))
+#elif FILTER_OP == FILTER_LESS_EQUAL
+#define FILTER_PASSES(x, t) ((x) <= (t))
+#elif FILTER_OP == FILTER_GREATER
+#define FILTER_PASSES(x, t) ((x) > (t))
+#elif FILTER_OP == FILTER_GREATER_EQUAL
+#define FILTER_PASSES(x, t) ((x) >= (t))
+#elif FILTER_OP == FILTER_EQUAL
+#define FILTER_PASSES(x, t) ((x) == (t))
+#elif FILTER_OP == FILTER_NOT_EQUAL
+#define FILTER_PASSES(x, t) ((x) != (t))
+#else
+#error "Unknown FILTER_OP"
+#endif
+
+#define FILTER(T)                                                                               \
+__kernel void filter_flag_##T(__global const T* input, __global uint* flags, const ulong count, \
+                              const T threshold)                                                \
+{                                                                                               \
+   size_t i = get_global_id(0);                                                                 \
+   if(i < count)                                                                                \
+       flags[i] = FILTER_PASSES(input[i], threshold) ? 1 : 0;                                   \
+}                                                                                               \
+                                                                                                \
+__kernel void filter_scatter_##T(__global const T* input, __global const uint* offsets,        \
+                                 __global T* output, __global uint* indices, const ulong count, \
+                                 const T threshold, const uint with_indices)                    \
+{                                                                                               \
+   size_t i = get_global_id(0);                                                                 \
+   if(i < count && FILTER_PASSES(input[i], threshold)) {                                        \
+       output[offsets[i]] = input[i];                                                           \
+       if(with_indices)                                                                         \
+           indices[offsets[i]] = i;                                                             \
+   }                                                                                            \
+}
+
+FILTER(int)
+FILTER(uint)
+FILTER(float)
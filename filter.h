@@ -0,0 +1,32 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+enum filter_type {
+        FILTER_INT,
+        FILTER_UINT,
+        FILTER_FLOAT,
+        FILTER_TYPE_COUNT
+};
+
+// Comparisons against the threshold, must match filter.cl
+enum filter_op {
+        FILTER_LESS,
+        FILTER_LESS_EQUAL,
+        FILTER_GREATER,
+        FILTER_GREATER_EQUAL,
+        FILTER_EQUAL,
+        FILTER_NOT_EQUAL
+};
+
+size_t filter_run(struct ocl_runtime *rt, enum filter_type type, enum filter_op op, const void *threshold,
+                  cl_mem input, cl_mem output, cl_mem indices, size_t count);
+size_t filter_predicate(struct ocl_runtime *rt, enum filter_type type, const char *predicate, cl_mem input,
+                        cl_mem output, cl_mem indices, size_t count);
+
+#endif //FILTER_H
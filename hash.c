@@ -0,0 +1,34 @@
+#include <string.h>
+
+#include "hash.h"
+
+#define HASH_PRIME (1099511628211ULL)
+
+/*
+ * 64-bit FNV-1a. Pass HASH_SEED to start a new hash, or a previous result to
+ * chain several fields into one key.
+ */
+uint64_t
+hash_bytes(const void *data, size_t length, uint64_t seed)
+{
+        const unsigned char *bytes = data;
+        uint64_t hash = seed;
+
+        for(size_t i = 0; i < length; i++) {
+                hash ^= bytes[i];
+                hash *= HASH_PRIME;
+        }
+        return hash;
+}
+
+/*
+ * Hashes a string including its terminator, so that chained fields
+ * "ab","c" and "a","bc" produce different keys.
+ */
+uint64_t
+hash_string(const char *str, uint64_t seed)
+{
+        if(str == NULL)
+                str = "";
+        return hash_bytes(str, strlen(str) + 1, seed);
+}
@@ -0,0 +1,12 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH_SEED (14695981039346656037ULL)
+
+uint64_t hash_bytes(const void *data, size_t length, uint64_t seed);
+uint64_t hash_string(const char *str, uint64_t seed);
+
+#endif //HASH_H
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "histogram.h"
+#include "util.h"
+
+
+/*
+ * Most bins a histogram can have on this device: the privatized bins of one
+ * work-group must fit in half of its local memory.
+ */
+unsigned int
+histogram_max_bins(struct ocl_runtime *rt)
+{
+        cl_int err;
+        cl_ulong local_mem;
+
+        err = clGetDeviceInfo(rt->device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem), &local_mem, NULL);
+	ocl_error("Unable to get device info", err);
+        return local_mem / 2 / sizeof(cl_uint);
+}
+
+/*
+ * Clears the device histogram, runs 'name' over 'count' elements of 'input'
+ * and reads the 'bins' counts back into 'counts'.
+ */
+static void
+histogram_run(struct ocl_runtime *rt, const char *name, cl_mem input, size_t count, unsigned int bins,
+              float lo, float scale, cl_uint *counts)
+{
+        cl_int err;
+        cl_event event;
+        cl_kernel clear = opencl_require_kernel(rt, "histogram.cl", "histogram_clear");
+        cl_kernel kernel = opencl_require_kernel(rt, "histogram.cl", name);
+        size_t local = opencl_local_size(rt, kernel, HISTOGRAM_LOCAL);
+        size_t groups = (count + local - 1) / local;
+        cl_uint compute_units;
+        cl_ulong count_arg = count;
+        cl_mem histogram;
+
+        if(bins == 0 || bins > histogram_max_bins(rt)) {
+                printf("Error: Unable to build a histogram of %u bins, at most %u fit in local memory\n",
+                       bins, histogram_max_bins(rt));
+                exit(1);
+        }
+
+        err = clGetDeviceInfo(rt->device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+	ocl_error("Unable to get device info", err);
+        if(groups > (size_t)compute_units * HISTOGRAM_GROUPS_PER_CU)
+                groups = (size_t)compute_units * HISTOGRAM_GROUPS_PER_CU;
+        if(groups == 0)
+                groups = 1;
+
+        histogram = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_uint) * bins);
+
+        err  = clSetKernelArg(clear, 0, sizeof(cl_mem), &histogram);
+        err |= clSetKernelArg(clear, 1, sizeof(cl_uint), &bins);
+	ocl_error("Setting histogram kernel arguments", err);
+        err = opencl_enqueue_range(rt->queue, clear, bins, 0, 0, NULL, NULL);
+	ocl_error("Clearing histogram", err);
+
+        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &histogram);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_ulong), &count_arg);
+        err |= clSetKernelArg(kernel, 3, sizeof(cl_uint), &bins);
+        err |= clSetKernelArg(kernel, 4, sizeof(cl_float), &lo);
+        err |= clSetKernelArg(kernel, 5, sizeof(cl_float), &scale);
+        err |= clSetKernelArg(kernel, 6, sizeof(cl_uint) * bins, NULL);
+	ocl_error("Setting histogram kernel arguments", err);
+        err = opencl_enqueue_range(rt->queue, kernel, groups * local, local, 0, NULL, &event);
+	ocl_error("Enqueueing histogram", err);
+        profile_event(&rt->profile, event, "histogram");
+        clReleaseEvent(event);
+
+        err = clEnqueueReadBuffer(rt->queue, histogram, CL_TRUE, 0, sizeof(cl_uint) * bins, counts, 0, NULL, NULL);
+	ocl_error("Reading histogram", err);
+        bufpool_release(&rt->pool, histogram);
+}
+
+/*
+ * Counts how often each value below 'bins' occurs in the first 'count'
+ * uints of 'input' into 'counts' ('bins' entries); larger values are not
+ * counted.
+ */
+void
+histogram_uint(struct ocl_runtime *rt, cl_mem input, size_t count, unsigned int bins, cl_uint *counts)
+{
+        histogram_run(rt, "histogram_uint", input, count, bins, 0.0f, 0.0f, counts);
+}
+
+/*
+ * Counts the first 'count' floats of 'input' into 'bins' equal bins spanning
+ * [lo, hi], stored in 'counts'. 'hi' itself is counted in the last bin;
+ * values outside the range and NaNs are not counted.
+ */
+void
+histogram_float(struct ocl_runtime *rt, cl_mem input, size_t count, float lo, float hi, unsigned int bins,
+                cl_uint *counts)
+{
+        if(!(hi > lo)) {
+                printf("Error: Empty histogram range [%f, %f]\n", lo, hi);
+                exit(1);
+        }
+        histogram_run(rt, "histogram_float", input, count, bins, lo, bins / (hi - lo), counts);
+}
@@ -0,0 +1,68 @@
+/*
+ * Histograms with privatized bins: every work-group counts its grid-strided
+ * share of the input in __local memory with local atomics, then adds its
+ * non-zero bins to the global histogram, so global atomics are per bin and
+ * work-group rather than per element. The global histogram must be cleared
+ * first (histogram_clear).
+ */
+
+/*
+ * uint values count in the bin of their value, values >= 'bins' are ignored.
+ */
+int histogram_bin_uint(uint v, uint bins, float lo, float scale, uint* bin)
+{
+   if(v >= bins)
+       return 0;
+   *bin = v;
+   return 1;
+}
+
+/*
+ * float values in [lo, hi] are spread over 'bins' equal bins, 'scale' being
+ * bins / (hi - lo); hi itself falls into the last bin. Values outside the
+ * range and NaNs are ignored.
+ */
+int histogram_bin_float(float v, uint bins, float lo, float scale, uint* bin)
+{
+   float f = (v - lo) * scale;
+   if(!(f >= 0.0f) || f > bins)
+       return 0;
+   *bin = min((uint)f, bins - 1);
+   return 1;
+}
+
+#define HISTOGRAM(T)                                                                            \
+__kernel void histogram_##T(__global const T* input, __global uint* histogram, const ulong count, \
+                            const uint bins, const float lo, const float scale,                 \
+                            __local uint* local_bins)                                           \
+{                                                                                               \
+   size_t lid = get_local_id(0);                                                                \
+   size_t local_size = get_local_size(0);                                                       \
+   size_t stride = get_global_size(0);                                                          \
+   uint bin;                                                                                    \
+                                                                                                \
+   for(size_t b = lid; b < bins; b += local_size)                                               \
+       local_bins[b] = 0;                                                                       \
+   barrier(CLK_LOCAL_MEM_FENCE);                                                                \
+                                                                                                \
+   for(size_t i = get_global_id(0); i < count; i += stride) {                                   \
+       if(histogram_bin_##T(input[i], bins, lo, scale, &bin))                                   \
+           atomic_inc(&local_bins[bin]);                                                        \
+   }                                                                                            \
+   barrier(CLK_LOCAL_MEM_FENCE);                                                                \
+                                                                                                \
+   for(size_t b = lid; b < bins; b += local_size) {                                             \
+       if(local_bins[b] != 0)                                                                   \
+           atomic_add(&histogram[b], local_bins[b]);                                            \
+   }                                                                                            \
+}
+
+HISTOGRAM(uint)
+HISTOGRAM(float)
+
+__kernel void histogram_clear(__global uint* histogram, const uint bins)
+{
+   size_t i = get_global_id(0);
+   if(i < bins)
+       histogram[i] = 0;
+}
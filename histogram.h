@@ -0,0 +1,18 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+#define HISTOGRAM_LOCAL (256)		// largest work-group size used
+#define HISTOGRAM_GROUPS_PER_CU (4)	// work-groups per compute unit
+
+unsigned int histogram_max_bins(struct ocl_runtime *rt);
+void histogram_uint(struct ocl_runtime *rt, cl_mem input, size_t count, unsigned int bins, cl_uint *counts);
+void histogram_float(struct ocl_runtime *rt, cl_mem input, size_t count, float lo, float hi, unsigned int bins,
+                     cl_uint *counts);
+
+#endif //HISTOGRAM_H
@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hostexec.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HOST_X86 (1)
+#include <immintrin.h>
+#endif
+
+#define HOST_MAX_THREADS (256)
+#define HOST_MIN_PER_THREAD (1 << 16)	// elements, below this threads cost more than they save
+
+typedef void (*host_kernel_fn)(const float *input, float *output, size_t count);
+
+struct host_kernel {
+        const char *name;
+        host_kernel_fn fn[HOST_ISA_COUNT];
+};
+
+struct host_part {
+        host_kernel_fn fn;
+        const float *input;
+        float *output;
+        size_t count;
+};
+
+
+static void
+square_scalar(const float *input, float *output, size_t count)
+{
+        for(size_t i = 0; i < count; i++)
+                output[i] = input[i] * input[i];
+}
+
+#ifdef HOST_X86
+__attribute__((target("sse2")))
+static void
+square_sse(const float *input, float *output, size_t count)
+{
+        size_t i = 0;
+
+        for(; i + 4 <= count; i += 4) {
+                __m128 v = _mm_loadu_ps(input + i);
+                _mm_storeu_ps(output + i, _mm_mul_ps(v, v));
+        }
+        square_scalar(input + i, output + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void
+square_avx2(const float *input, float *output, size_t count)
+{
+        size_t i = 0;
+
+        for(; i + 16 <= count; i += 16) {
+                __m256 a = _mm256_loadu_ps(input + i);
+                __m256 b = _mm256_loadu_ps(input + i + 8);
+                _mm256_storeu_ps(output + i, _mm256_mul_ps(a, a));
+                _mm256_storeu_ps(output + i + 8, _mm256_mul_ps(b, b));
+        }
+        square_scalar(input + i, output + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static void
+square_avx512(const float *input, float *output, size_t count)
+{
+        size_t i = 0;
+
+        for(; i + 32 <= count; i += 32) {
+                __m512 a = _mm512_loadu_ps(input + i);
+                __m512 b = _mm512_loadu_ps(input + i + 16);
+                _mm512_storeu_ps(output + i, _mm512_mul_ps(a, a));
+                _mm512_storeu_ps(output + i + 16, _mm512_mul_ps(b, b));
+        }
+        square_scalar(input + i, output + i, count - i);
+}
+#else
+#define square_sse square_scalar
+#define square_avx2 square_scalar
+#define square_avx512 square_scalar
+#endif
+
+/*
+ * Host implementations of device kernels, indexed by enum host_isa.
+ */
+static const struct host_kernel host_kernels[] = {
+        { "square", { square_scalar, square_sse, square_avx2, square_avx512 } },
+};
+
+static const char *host_isa_names[HOST_ISA_COUNT] = { "scalar", "sse", "avx2", "avx512" };
+
+
+/*
+ * Widest instruction set supported by this CPU. $OPENCL_HOST_ISA caps it,
+ * e.g. "sse" or "scalar".
+ */
+enum host_isa
+host_isa(void)
+{
+        enum host_isa isa = HOST_ISA_SCALAR;
+        const char *env = getenv("OPENCL_HOST_ISA");
+
+#ifdef HOST_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("sse2"))
+                isa = HOST_ISA_SSE;
+        if(__builtin_cpu_supports("avx2"))
+                isa = HOST_ISA_AVX2;
+        if(__builtin_cpu_supports("avx512f"))
+                isa = HOST_ISA_AVX512;
+#endif
+        if(env != NULL) {
+                for(int i = 0; i < HOST_ISA_COUNT; i++) {
+                        if(strcmp(env, host_isa_names[i]) == 0 && (enum host_isa)i < isa)
+                                isa = i;
+                }
+        }
+        return isa;
+}
+
+const char *
+host_isa_name(enum host_isa isa)
+{
+        return host_isa_names[isa];
+}
+
+/*
+ * Worker threads to use: one per online core, or $OPENCL_HOST_THREADS.
+ */
+unsigned int
+host_threads(void)
+{
+        const char *env = getenv("OPENCL_HOST_THREADS");
+        long cores = (env != NULL) ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+        if(cores < 1)
+                cores = 1;
+        if(cores > HOST_MAX_THREADS)
+                cores = HOST_MAX_THREADS;
+        return cores;
+}
+
+static void *
+host_worker(void *arg)
+{
+        struct host_part *part = arg;
+
+        part->fn(part->input, part->output, part->count);
+        return NULL;
+}
+
+/*
+ * Runs the host implementation of 'kernel_name' over 'count' floats, using
+ * the widest SIMD code path of this CPU on every core. Returns 0 if the
+ * kernel has no host implementation.
+ */
+int
+host_run(const char *kernel_name, const float *input, float *output, size_t count)
+{
+        struct host_part parts[HOST_MAX_THREADS];
+        pthread_t threads[HOST_MAX_THREADS];
+        host_kernel_fn fn = NULL;
+        unsigned int num_threads = host_threads();
+        size_t per_thread;
+
+        for(size_t i = 0; i < sizeof(host_kernels) / sizeof(host_kernels[0]); i++) {
+                if(strcmp(host_kernels[i].name, kernel_name) == 0)
+                        fn = host_kernels[i].fn[host_isa()];
+        }
+        if(fn == NULL)
+                return 0;
+
+        if(count / HOST_MIN_PER_THREAD < num_threads)
+                num_threads = (count / HOST_MIN_PER_THREAD > 0) ? count / HOST_MIN_PER_THREAD : 1;
+
+        // Keep every share a multiple of 16 floats, so threads never share a cache line of an aligned array
+        per_thread = (count + num_threads - 1) / num_threads;
+        per_thread = (per_thread + 15) / 16 * 16;
+
+        for(unsigned int t = 0; t < num_threads; t++) {
+                size_t offset = t * per_thread;
+                parts[t].fn = fn;
+                parts[t].input = input + offset;
+                parts[t].output = output + offset;
+                parts[t].count = (offset >= count) ? 0 : (count - offset < per_thread) ? count - offset : per_thread;
+        }
+
+        // The calling thread takes the first share itself
+        for(unsigned int t = 1; t < num_threads; t++) {
+                if(pthread_create(&threads[t], NULL, host_worker, &parts[t]) != 0) {
+                        printf("Error: Unable to start host thread\n");
+                        exit(1);
+                }
+        }
+        host_worker(&parts[0]);
+        for(unsigned int t = 1; t < num_threads; t++)
+                pthread_join(threads[t], NULL);
+
+        return 1;
+}
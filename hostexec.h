@@ -0,0 +1,19 @@
+#ifndef HOSTEXEC_H
+#define HOSTEXEC_H
+
+#include <stddef.h>
+
+enum host_isa {
+        HOST_ISA_SCALAR,
+        HOST_ISA_SSE,
+        HOST_ISA_AVX2,
+        HOST_ISA_AVX512,
+        HOST_ISA_COUNT
+};
+
+enum host_isa host_isa(void);
+const char *host_isa_name(enum host_isa isa);
+unsigned int host_threads(void);
+int host_run(const char *kernel_name, const float *input, float *output, size_t count);
+
+#endif //HOSTEXEC_H
@@ -0,0 +1,161 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calibrate.h"
+#include "hostexec.h"
+#include "multidev.h"
+#include "stream.h"
+#include "util.h"
+
+struct multidev_part {
+        struct ocl_runtime *rt;
+        cl_kernel kernel;
+        const char *input;
+        char *output;
+        size_t count;
+        size_t elem_size;
+};
+
+
+/*
+ * Sets up a runtime for every available device on every platform and loads
+ * 'cl_source_filename' on each. Every device is weighted by its calibrated
+ * throughput on a 'count' element job (cached per host, see calibrate.c).
+ */
+void
+multidev_setup(struct ocl_multidev *md, const char *cl_source_filename, size_t count, unsigned int flags)
+{
+	cl_int err = CL_SUCCESS;
+
+        cl_platform_id platform[MAX_RESOURCES];
+        cl_uint num_platform;
+        cl_device_id devices[MAX_RESOURCES];
+        cl_uint num_devices;
+        cl_bool available;
+        struct calibration result;
+
+        memset(md, 0, sizeof(*md));
+
+        num_platform = opencl_platforms(platform);
+
+        for(unsigned int i = 0; i < num_platform; i++) {
+                err = clGetDeviceIDs(platform[i], CL_DEVICE_TYPE_ALL, sizeof(devices), devices, &num_devices);
+		ocl_error("Getting device ids", err);
+
+                for(unsigned int j = 0; j < num_devices && md->num_devices < MULTIDEV_MAX_DEVICES; ++j) {
+                        err = clGetDeviceInfo(devices[j], CL_DEVICE_AVAILABLE, sizeof(available), &available, NULL);
+			ocl_error("Unable to get device info", err);
+                        if(!available || !calibrate_device(platform[i], devices[j], count, &result))
+                                continue;
+
+                        struct ocl_runtime *rt = malloc(sizeof(*rt));
+                        if(rt == NULL) {
+                                printf("Error: Out of memory setting up devices\n");
+                                exit(1);
+                        }
+                        setup_opencl_device(rt, i, j, flags);
+                        opencl_program(rt, cl_source_filename, NULL);
+
+                        md->runtimes[md->num_devices] = rt;
+                        md->throughput[md->num_devices] = calibration_throughput(&result);
+                        md->num_devices++;
+                }
+        }
+
+        if(md->num_devices == 0)
+                fprintf(stderr, "No suitable device was found! Falling back to the host.\n");
+}
+
+void
+multidev_destroy(struct ocl_multidev *md)
+{
+        for(unsigned int i = 0; i < md->num_devices; i++) {
+                destroy_opencl(md->runtimes[i]);
+                free(md->runtimes[i]);
+        }
+        memset(md, 0, sizeof(*md));
+}
+
+/*
+ * Splits 'count' elements into contiguous shares proportional to each
+ * device's throughput. The remainder left by rounding goes to the fastest
+ * device.
+ */
+void
+multidev_partition(const struct ocl_multidev *md, size_t count, size_t *shares)
+{
+        double total = 0.0;
+        size_t assigned = 0;
+        unsigned int fastest = 0;
+
+        for(unsigned int i = 0; i < md->num_devices; i++) {
+                total += md->throughput[i];
+                if(md->throughput[i] > md->throughput[fastest])
+                        fastest = i;
+        }
+        for(unsigned int i = 0; i < md->num_devices; i++) {
+                shares[i] = (total > 0.0) ? (size_t)(count * (md->throughput[i] / total)) : 0;
+                assigned += shares[i];
+        }
+        shares[fastest] += count - assigned;
+}
+
+static void *
+multidev_worker(void *arg)
+{
+        struct multidev_part *part = arg;
+
+        stream_run(part->rt, part->kernel, part->input, part->output, part->count, part->elem_size, 0);
+        return NULL;
+}
+
+/*
+ * Runs 'kernel_name(input, output, count)' over 'count' elements with every
+ * device working on its own share at the same time. Results land directly in
+ * their place in 'output'. Without any device the host implementation runs.
+ */
+void
+multidev_run(struct ocl_multidev *md, const char *kernel_name, const void *input, void *output,
+             size_t count, size_t elem_size)
+{
+        size_t shares[MULTIDEV_MAX_DEVICES];
+        struct multidev_part parts[MULTIDEV_MAX_DEVICES];
+        pthread_t threads[MULTIDEV_MAX_DEVICES];
+        size_t offset = 0;
+
+        if(md->num_devices == 0) {
+                if(elem_size != sizeof(float) || !host_run(kernel_name, input, output, count)) {
+                        printf("Error: Kernel %s has no host implementation\n", kernel_name);
+                        exit(1);
+                }
+                return;
+        }
+
+        multidev_partition(md, count, shares);
+
+        for(unsigned int i = 0; i < md->num_devices; i++) {
+                parts[i].rt = md->runtimes[i];
+                parts[i].kernel = opencl_kernel(md->runtimes[i], kernel_name);
+                parts[i].input = (const char *)input + offset * elem_size;
+                parts[i].output = (char *)output + offset * elem_size;
+                parts[i].count = shares[i];
+                parts[i].elem_size = elem_size;
+                offset += shares[i];
+
+                if(parts[i].kernel == NULL) {
+                        printf("Error: Kernel %s is not loaded\n", kernel_name);
+                        exit(1);
+                }
+                if(pthread_create(&threads[i], NULL, multidev_worker, &parts[i]) != 0) {
+                        printf("Error: Unable to start device thread\n");
+                        exit(1);
+                }
+        }
+
+        for(unsigned int i = 0; i < md->num_devices; i++)
+                pthread_join(threads[i], NULL);
+}
@@ -0,0 +1,26 @@
+#ifndef MULTIDEV_H
+#define MULTIDEV_H
+
+#include <stddef.h>
+
+#include "opencl.h"
+
+#define MULTIDEV_MAX_DEVICES (MAX_RESOURCES)
+
+/*
+ * One runtime per usable device across all platforms, for splitting a single
+ * NDRange between them.
+ */
+struct ocl_multidev {
+        unsigned int num_devices;
+        struct ocl_runtime *runtimes[MULTIDEV_MAX_DEVICES];
+        double throughput[MULTIDEV_MAX_DEVICES];	// elements per second
+};
+
+void multidev_setup(struct ocl_multidev *md, const char *cl_source_filename, size_t count, unsigned int flags);
+void multidev_destroy(struct ocl_multidev *md);
+void multidev_partition(const struct ocl_multidev *md, size_t count, size_t *shares);
+void multidev_run(struct ocl_multidev *md, const char *kernel_name, const void *input, void *output,
+                  size_t count, size_t elem_size);
+
+#endif //MULTIDEV_H
@@ -6,101 +6,358 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include "CL/cl_ext.h"
+
+#include "bincache.h"
+#include "hash.h"
 #include "opencl.h"
+#include "source.h"
 #include "util.h"
 
 
-void
-setup_opencl(const char* cl_source_filename, const char* cl_source_main, cl_device_id* device_id,
-             cl_kernel* kernel, cl_context* context, cl_command_queue* queue)
+/*
+ * Fills 'platforms' (MAX_RESOURCES entries) and returns how many there are.
+ * A host without any installed OpenCL implementation has zero platforms
+ * rather than an error.
+ */
+cl_uint
+opencl_platforms(cl_platform_id *platforms)
 {
-        cl_int err;					// error code returned from api calls
-
-        cl_platform_id platform_id;			// compute device id
-        cl_program program;				// compute program
-        cl_device_id devices[MAX_RESOURCES];
-        cl_platform_id platforms[MAX_RESOURCES];
+        cl_uint num_platforms = 0;
+        cl_int err = clGetPlatformIDs(MAX_RESOURCES, platforms, &num_platforms);
 
+        if(err == CL_PLATFORM_NOT_FOUND_KHR)
+                return 0;
+	ocl_error("Getting platform ids", err);
+        return (num_platforms < MAX_RESOURCES) ? num_platforms : MAX_RESOURCES;
+}
 
+/*
+ * Sets up the best device. If there is none, 'rt' is marked host_fallback
+ * and jobs must run through host_run() instead.
+ */
+void
+setup_opencl(struct ocl_runtime *rt, unsigned int flags)
+{
         unsigned int best_platform = 0;
         unsigned int best_device = 0;
         print_devices(0);
 
         if(!get_best_device(&best_platform, &best_device)) {
-                printf("No suitable device was found! Try using an OpenCL1.1 compatible device.\n");
-                exit(1);
+                fprintf(stderr, "No suitable device was found! Falling back to the host.\n");
+                memset(rt, 0, sizeof(*rt));
+                rt->flags = flags;
+                rt->host_fallback = 1;
+                return;
         }
-        printf("Initiating platform-%d device-%d.\n", best_platform, best_device);
+        setup_opencl_device(rt, best_platform, best_device, flags);
+}
+
+/*
+ * Like setup_opencl(), but for an explicitly chosen device, e.g. one picked
+ * by get_fastest_device().
+ */
+void
+setup_opencl_device(struct ocl_runtime *rt, unsigned int platform, unsigned int device, unsigned int flags)
+{
+        cl_int err;					// error code returned from api calls
+
+        cl_device_id devices[MAX_RESOURCES];
+        cl_platform_id platforms[MAX_RESOURCES];
 
+        fprintf(stderr, "Initiating platform-%d device-%d.\n", platform, device);
+
+        memset(rt, 0, sizeof(*rt));
+        rt->flags = flags;
+        profile_init(&rt->profile, (flags & OPENCL_PROFILING) != 0);
 
 
         // Platform
         err = clGetPlatformIDs(MAX_RESOURCES, platforms, NULL);
 	ocl_error("Getting platform id", err);
 
-        platform_id = platforms[best_platform];
+        rt->platform = platforms[platform];
 
         // Device
-        err = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ALL, sizeof(devices), devices, NULL); //NULL, ignore number returned devices.
+        err = clGetDeviceIDs(rt->platform, CL_DEVICE_TYPE_ALL, sizeof(devices), devices, NULL); //NULL, ignore number returned devices.
 	ocl_error("Getting device ids", err);
 
-        *device_id = devices[best_device];
+        rt->device = devices[device];
+
+        err = clGetDeviceInfo(rt->device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(rt->unified_memory),
+                              &rt->unified_memory, NULL);
+	ocl_error("Unable to get device info", err);
+        if(getenv("OPENCL_NO_ZERO_COPY") != NULL)
+                rt->unified_memory = CL_FALSE;
 
         // Context
-        *context = clCreateContext(0, 1, device_id, NULL, NULL, &err);
+        rt->context = clCreateContext(0, 1, &rt->device, NULL, NULL, &err);
 	ocl_error("Creating context", err);
 
-        // Command-queue
-        *queue = clCreateCommandQueue(*context, *device_id, 0, &err);
+        // Command-queues, one for compute and one per transfer direction
+        cl_command_queue_properties properties = (flags & OPENCL_PROFILING) ? CL_QUEUE_PROFILING_ENABLE : 0;
+        rt->queue = clCreateCommandQueue(rt->context, rt->device, properties, &err);
+	ocl_error("Creating command queue", err);
+        rt->upload_queue = clCreateCommandQueue(rt->context, rt->device, properties, &err);
 	ocl_error("Creating command queue", err);
+        rt->download_queue = clCreateCommandQueue(rt->context, rt->device, properties, &err);
+	ocl_error("Creating command queue", err);
+
+        bufpool_init(&rt->pool, rt->context, rt->device, 0);
+}
+
+/*
+ * Returns the registered program 'name' built with 'opts', or NULL.
+ */
+static cl_program
+opencl_find_program(struct ocl_runtime *rt, const char *name, const char *opts)
+{
+        for(unsigned int i = 0; i < rt->num_programs; i++) {
+                if(strcmp(rt->programs[i].filename, name) == 0 && strcmp(rt->programs[i].options, opts) == 0)
+                        return rt->programs[i].program;
+        }
+        return NULL;
+}
 
+/*
+ * Builds 'source' with 'options' (from the binary cache if possible),
+ * registers the program under 'name' and all of its kernels.
+ */
+static cl_program
+opencl_register_program(struct ocl_runtime *rt, const char *name, const char *source, size_t source_len,
+                        uint64_t source_hash, const char *options)
+{
+        cl_int err;
+        cl_program program;
+        cl_kernel kernels[MAX_KERNELS];
+        cl_uint num_kernels;
+        const char *opts = (options != NULL) ? options : "";
+
+        if(rt->num_programs >= MAX_PROGRAMS || strlen(name) >= MAX_NAME_LEN || strlen(opts) >= MAX_NAME_LEN) {
+                printf("Error: Unable to register program %s\n", name);
+                exit(1);
+        }
+
+        // Load the program from the binary cache, or build it from source
+        program = bincache_build_program(rt->context, rt->device, source, source_len, source_hash, options);
 
-        // Read .cl source into memory
-        int cl_source_len = 0;
-        char* cl_source = file_contents(cl_source_filename, &cl_source_len);
+        strcpy(rt->programs[rt->num_programs].filename, name);
+        strcpy(rt->programs[rt->num_programs].options, opts);
+        rt->programs[rt->num_programs].program = program;
+        rt->num_programs++;
 
 
-        // Create thes compute program from the source buffer
-        program = clCreateProgramWithSource(*context, 1, (const char **) &cl_source, NULL, &err);
-	ocl_error("Failed to create compute program", err);
+        // Create every compute kernel in the program and add it to the registry
+        err = clCreateKernelsInProgram(program, MAX_KERNELS, kernels, &num_kernels);
+	ocl_error("Failed to create compute kernels", err);
 
+        for(cl_uint i = 0; i < num_kernels; i++) {
+                struct ocl_kernel *entry = &rt->kernels[rt->num_kernels];
 
-        // Build the program executable
-        err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-        if (err != CL_SUCCESS) {
-                char* build_log;
-                size_t log_size;
-                // First call to know the proper size
-                clGetProgramBuildInfo(program, *device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-                build_log = malloc(sizeof(char)*(log_size+1));
-                if(log_size > 0 && build_log != NULL) {
-	                // Second call to get the log
-	                clGetProgramBuildInfo(program, *device_id, CL_PROGRAM_BUILD_LOG, log_size, build_log, NULL);
-	                build_log[log_size] = '\0';
-	                printf("%s\n", build_log);
-	                free(build_log);
+                if(rt->num_kernels >= MAX_KERNELS) {
+                        printf("Error: Too many kernels registered\n");
+                        exit(1);
                 }
+                err = clGetKernelInfo(kernels[i], CL_KERNEL_FUNCTION_NAME, sizeof(entry->name), entry->name, NULL);
+		ocl_error("Getting kernel info", err);
+                entry->program = program;
+                entry->kernel = kernels[i];
+                rt->num_kernels++;
+        }
+
+        return program;
+}
 
-                exit(err);
+/*
+ * Returns the program built from 'cl_source_filename' with 'options' and
+ * registers all of its kernels. Each file/options pair is only built once
+ * per runtime.
+ */
+cl_program
+opencl_program(struct ocl_runtime *rt, const char *cl_source_filename, const char *options)
+{
+        cl_program program;
+        const char *opts = (options != NULL) ? options : "";
+
+        program = opencl_find_program(rt, cl_source_filename, opts);
+        if(program != NULL)
+                return program;
+
+        // Get the .cl source, embedded in the binary or mapped from disk
+        struct kernel_source cl_source;
+        if(!source_load(cl_source_filename, &cl_source))
+                exit(1);
+
+        program = opencl_register_program(rt, cl_source_filename, cl_source.data, cl_source.size, cl_source.hash,
+                                          options);
+        source_release(&cl_source);
+        return program;
+}
+
+/*
+ * Like opencl_program(), for source generated at run time. 'name' stands in
+ * for the file name and must differ between different sources, e.g. by
+ * including their hash.
+ */
+cl_program
+opencl_program_source(struct ocl_runtime *rt, const char *name, const char *source, size_t source_len,
+                      const char *options)
+{
+        cl_program program = opencl_find_program(rt, name, (options != NULL) ? options : "");
+
+        if(program != NULL)
+                return program;
+        return opencl_register_program(rt, name, source, source_len, hash_bytes(source, source_len, HASH_SEED),
+                                       options);
+}
+
+/*
+ * Returns the kernel 'name' from any program loaded with opencl_program(), or
+ * NULL if no such kernel has been loaded.
+ */
+cl_kernel
+opencl_kernel(struct ocl_runtime *rt, const char *name)
+{
+        for(unsigned int i = 0; i < rt->num_kernels; i++) {
+                if(strcmp(rt->kernels[i].name, name) == 0)
+                        return rt->kernels[i].kernel;
+        }
+        return NULL;
+}
+
+/*
+ * Returns the kernel 'name' of 'program', for programs that are built more
+ * than once with different options and so define the same kernel names.
+ */
+cl_kernel
+opencl_program_kernel(struct ocl_runtime *rt, cl_program program, const char *name)
+{
+        for(unsigned int i = 0; i < rt->num_kernels; i++) {
+                if(rt->kernels[i].program == program && strcmp(rt->kernels[i].name, name) == 0)
+                        return rt->kernels[i].kernel;
+        }
+        return NULL;
+}
+
+/*
+ * Returns the kernel 'name' of 'cl_source_filename', loading the file on
+ * first use. A missing kernel is fatal.
+ */
+cl_kernel
+opencl_require_kernel(struct ocl_runtime *rt, const char *cl_source_filename, const char *name)
+{
+        cl_program program = opencl_program(rt, cl_source_filename, NULL);
+        cl_kernel kernel = opencl_program_kernel(rt, program, name);
+
+        if(kernel == NULL) {
+                printf("Error: Kernel %s is not in %s\n", name, cl_source_filename);
+                exit(1);
         }
+        return kernel;
+}
 
+/*
+ * Largest power of two work-group size up to 'max' that 'kernel' can run
+ * with on this device, for kernels that reduce in __local memory as a tree.
+ */
+size_t
+opencl_local_size(struct ocl_runtime *rt, cl_kernel kernel, size_t max)
+{
+        cl_int err;
+        size_t limit;
+        size_t local = 1;
+
+        err = clGetKernelWorkGroupInfo(kernel, rt->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(limit), &limit, NULL);
+	ocl_error("Failed to retrieve kernel work group info", err);
+        if(limit > max)
+                limit = max;
+        while(local * 2 <= limit)
+                local *= 2;
+        return local;
+}
+
+/*
+ * Enqueues 'kernel' over 'global' work-items in groups of 'local' (0 lets the
+ * driver choose). Ranges larger than OPENCL_MAX_LAUNCH are split into several
+ * launches using the global work offset, so kernels indexing with
+ * get_global_id() see one contiguous range and no launch overflows 32-bit ids.
+ * The first launch waits for 'wait', '*event' (if not NULL) completes with
+ * the last one. Returns the first error.
+ */
+cl_int
+opencl_enqueue_range(cl_command_queue queue, cl_kernel kernel, size_t global, size_t local,
+                     cl_uint num_wait, const cl_event *wait, cl_event *event)
+{
+        return opencl_enqueue_range_span(queue, kernel, global, local, num_wait, wait, NULL, event);
+}
 
-        // Create the compute kernel in the program we wish to run
-        *kernel = clCreateKernel(program, cl_source_main, &err);
-	ocl_error("Failed to create compute kernel", err);
+/*
+ * Like opencl_enqueue_range(), but also returns the event of the first launch
+ * in '*first', so the whole range can be timed from the start of the first
+ * launch to the end of the last. With a single launch both are the same
+ * event, retained once for each; the caller releases both.
+ */
+cl_int
+opencl_enqueue_range_span(cl_command_queue queue, cl_kernel kernel, size_t global, size_t local,
+                          cl_uint num_wait, const cl_event *wait, cl_event *first, cl_event *last)
+{
+        cl_int err = CL_SUCCESS;
+        size_t max_launch = OPENCL_MAX_LAUNCH;
+        size_t offset = 0;
+
+        if(local > 0)
+                max_launch -= max_launch % local;
+        if(first != NULL)
+                *first = NULL;
+        if(last != NULL)
+                *last = NULL;
+
+        do {
+                size_t n = (global - offset < max_launch) ? global - offset : max_launch;
+                int want_first = (offset == 0 && first != NULL);
+                int want_last = (offset + n == global && last != NULL);
+                cl_event launch = NULL;
+
+                // An in-order queue orders the launches, only the first needs the wait list
+                err = clEnqueueNDRangeKernel(queue, kernel, 1, &offset, &n, (local > 0) ? &local : NULL,
+                                             (offset == 0) ? num_wait : 0, (offset == 0) ? wait : NULL,
+                                             (want_first || want_last) ? &launch : NULL);
+                if(err != CL_SUCCESS)
+                        return err;
+                if(want_first)
+                        *first = launch;
+                if(want_first && want_last)
+                        clRetainEvent(launch);
+                if(want_last)
+                        *last = launch;
+                offset += n;
+        } while(offset < global);
+        return err;
 }
 
 /*
- * Free allocated OpenCL resources. Note: cl_mem objects are NOT free'd.
+ * Free allocated OpenCL resources. Pooled cl_mem objects are free'd, buffers
+ * that were never returned to the pool are NOT.
  */
 void
-destroy_opencl(cl_program* program, cl_kernel* kernel, cl_context* context, cl_command_queue* queue)
+destroy_opencl(struct ocl_runtime *rt)
 {
         // Shutdown and cleanup
-        clReleaseProgram(*program);
-        clReleaseKernel(*kernel);
-        clReleaseCommandQueue(*queue);
-        clReleaseContext(*context);
+        if(rt->host_fallback) {
+                memset(rt, 0, sizeof(*rt));
+                return;
+        }
+        for(unsigned int i = 0; i < rt->num_kernels; i++)
+                clReleaseKernel(rt->kernels[i].kernel);
+        for(unsigned int i = 0; i < rt->num_programs; i++)
+                clReleaseProgram(rt->programs[i].program);
+        bufpool_destroy(&rt->pool);
+        clReleaseCommandQueue(rt->queue);
+        clReleaseCommandQueue(rt->upload_queue);
+        clReleaseCommandQueue(rt->download_queue);
+        clReleaseContext(rt->context);
+        profile_release(&rt->profile);
+        memset(rt, 0, sizeof(*rt));
 }
 
 
@@ -115,37 +372,42 @@ get_best_device(unsigned int *ret_platform, unsigned int *ret_device)
 	unsigned long long score;
 
         cl_platform_id platform[MAX_RESOURCES];
-        cl_uint num_platform = MAX_RESOURCES;
+        cl_uint num_platform;
         cl_device_id devices[MAX_RESOURCES];
         cl_uint num_devices;
         cl_uint numberOfCores;
         cl_long amountOfMemory;
         cl_uint clockFreq;
         cl_ulong maxAllocatableMem;
+        cl_bool available;
 
-        err = clGetPlatformIDs(MAX_RESOURCES, platform, &num_platform);
-	ocl_error("Getting platform ids", err);
+        num_platform = opencl_platforms(platform);
 
         for(unsigned int i = 0; i < num_platform; i++) {
                 err = clGetDeviceIDs(platform[i], CL_DEVICE_TYPE_ALL, sizeof(devices), devices, &num_devices);
 		ocl_error("Getting device ids", err);
 
                 for(unsigned int j = 0; j < num_devices; ++j) {
-                        err  = clGetDeviceInfo(devices[j], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(numberOfCores), &numberOfCores, NULL);
+                        err  = clGetDeviceInfo(devices[j], CL_DEVICE_AVAILABLE, sizeof(available), &available, NULL);
+                        err |= clGetDeviceInfo(devices[j], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(numberOfCores), &numberOfCores, NULL);
                         err |= clGetDeviceInfo(devices[j], CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(amountOfMemory), &amountOfMemory, NULL);
                         err |= clGetDeviceInfo(devices[j], CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(clockFreq), &clockFreq, NULL);
                         err |= clGetDeviceInfo(devices[j], CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAllocatableMem), &maxAllocatableMem, NULL);
 			ocl_error("Unable to get device info", err);
 
-			score = clockFreq*numberOfCores + amountOfMemory;
+			if(!available)
+				continue;
+
+			score = (unsigned long long)clockFreq*numberOfCores + amountOfMemory;
 		        if(score>best_score) {
+		                best_score = score;
 		                *ret_platform = i;
 		                *ret_device = j;
 		        }
                 }
 
         }
-        return ((best_score != 0) ? 0 : 1);
+        return (best_score != 0);
 }
 
 
@@ -155,7 +417,7 @@ print_devices(int print_extensions)
 	cl_int err = CL_SUCCESS;
 
         cl_platform_id platform[MAX_RESOURCES];
-        cl_uint num_platform = MAX_RESOURCES;
+        cl_uint num_platform;
         char vendor[1024];
         cl_device_id devices[MAX_RESOURCES];
         cl_uint num_devices;
@@ -169,8 +431,7 @@ print_devices(int print_extensions)
         char extensions[4096];
         size_t extensions_len = 0;
 
-        err = clGetPlatformIDs(MAX_RESOURCES, platform, &num_platform);
-	ocl_error("Getting platform ids", err);
+        num_platform = opencl_platforms(platform);
 
         for(unsigned int i = 0; i < num_platform; i++) {
                 err = clGetPlatformInfo (platform[i], CL_PLATFORM_VENDOR, sizeof(vendor), vendor, NULL);
@@ -190,19 +451,19 @@ print_devices(int print_extensions)
                         err |= clGetDeviceInfo(devices[j], CL_DEVICE_EXTENSIONS, sizeof(extensions), &extensions, &extensions_len);
 			ocl_error("Unable to get device info", err);
 
-                        printf("Platform-%d Device-%d\t%s - %s\tCores: %d\tMemory: %ldMB\tAvailable: %s\n",
-                               i, j, vendor, deviceName, numberOfCores, (maxAllocatableMem/(1024*1024)), (available ? "Yes" : "No"));
+                        fprintf(stderr, "Platform-%d Device-%d\t%s - %s\tCores: %d\tMemory: %ldMB\tAvailable: %s\n",
+                                i, j, vendor, deviceName, numberOfCores, (maxAllocatableMem/(1024*1024)), (available ? "Yes" : "No"));
                         char* an_extension;
                         if (extensions_len > 0 && print_extensions) {
 
-                                printf("\t\tExtensions: \t");
+                                fprintf(stderr, "\t\tExtensions: \t");
                                 an_extension = strtok(extensions, " ");
                                 while (an_extension != NULL) {
-                                        printf("%s\n\t\t\t\t", an_extension);
+                                        fprintf(stderr, "%s\n\t\t\t\t", an_extension);
                                         an_extension = strtok(NULL, " ");
                                 }
                         }
-                        printf("\n");
+                        fprintf(stderr, "\n");
                 }
 
         }
@@ -3,11 +3,69 @@
 
 #include "CL/cl.h"
 
+#include "bufpool.h"
+#include "profile.h"
+
 #define MAX_RESOURCES (32)
+#define MAX_PROGRAMS (32)
+#define MAX_KERNELS (128)
+#define MAX_NAME_LEN (256)
+#define OPENCL_MAX_LAUNCH ((size_t)1 << 31)	// work-items per NDRange launch
+
+// setup_opencl() flags
+#define OPENCL_PROFILING (1 << 0)	// create queues with CL_QUEUE_PROFILING_ENABLE
+
+struct ocl_program {
+        char filename[MAX_NAME_LEN];
+        char options[MAX_NAME_LEN];
+        cl_program program;
+};
+
+struct ocl_kernel {
+        char name[MAX_NAME_LEN];
+        cl_program program;
+        cl_kernel kernel;
+};
+
+/*
+ * Everything needed to run kernels on one device. Set up once with
+ * setup_opencl() and reused for any number of jobs, then released with
+ * destroy_opencl().
+ */
+struct ocl_runtime {
+        cl_platform_id platform;
+        cl_device_id device;
+        cl_context context;
+        cl_command_queue queue;
+        cl_command_queue upload_queue;	// host to device transfers overlapping 'queue'
+        cl_command_queue download_queue;	// device to host transfers overlapping 'queue'
+        unsigned int flags;
+        int host_fallback;		// no usable device, run on the host (see hostexec.c)
+        cl_bool unified_memory;		// device shares physical memory with the host
+        struct profile profile;		// filled when OPENCL_PROFILING is set
+        struct bufpool pool;		// recycled device buffers
+
+        unsigned int num_programs;
+        struct ocl_program programs[MAX_PROGRAMS];
+        unsigned int num_kernels;
+        struct ocl_kernel kernels[MAX_KERNELS];
+};
 
-void setup_opencl(const char* cl_source_filename, const char* cl_source_main, cl_device_id* device_id,
-				 cl_kernel* kernel, cl_context* context, cl_command_queue* queue);
-void destroy_opencl(cl_program* program, cl_kernel* kernel, cl_context* context, cl_command_queue* queue);
+cl_uint opencl_platforms(cl_platform_id *platforms);
+void setup_opencl(struct ocl_runtime *rt, unsigned int flags);
+void setup_opencl_device(struct ocl_runtime *rt, unsigned int platform, unsigned int device, unsigned int flags);
+void destroy_opencl(struct ocl_runtime *rt);
+cl_program opencl_program(struct ocl_runtime *rt, const char *cl_source_filename, const char *options);
+cl_program opencl_program_source(struct ocl_runtime *rt, const char *name, const char *source, size_t source_len,
+                                 const char *options);
+cl_kernel opencl_kernel(struct ocl_runtime *rt, const char *name);
+cl_kernel opencl_program_kernel(struct ocl_runtime *rt, cl_program program, const char *name);
+cl_kernel opencl_require_kernel(struct ocl_runtime *rt, const char *cl_source_filename, const char *name);
+size_t opencl_local_size(struct ocl_runtime *rt, cl_kernel kernel, size_t max);
+cl_int opencl_enqueue_range(cl_command_queue queue, cl_kernel kernel, size_t global, size_t local,
+                            cl_uint num_wait, const cl_event *wait, cl_event *event);
+cl_int opencl_enqueue_range_span(cl_command_queue queue, cl_kernel kernel, size_t global, size_t local,
+                                 cl_uint num_wait, const cl_event *wait, cl_event *first, cl_event *last);
 void print_devices();
 int get_best_device(unsigned int *ret_platform, unsigned int *ret_device);
 
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+#include "util.h"
+
+
+void
+profile_init(struct profile *prof, int enabled)
+{
+        memset(prof, 0, sizeof(*prof));
+        prof->enabled = enabled;
+}
+
+void
+profile_release(struct profile *prof)
+{
+        for(size_t i = 0; i < prof->count; i++) {
+                if(prof->records[i].event != NULL)
+                        clReleaseEvent(prof->records[i].event);
+        }
+        free(prof->records);
+        memset(prof, 0, sizeof(*prof));
+}
+
+/*
+ * Remembers 'event' so that its timestamps can be read once it completes.
+ * The event is retained, the caller keeps its own reference. Does nothing
+ * if profiling is disabled.
+ */
+void
+profile_event(struct profile *prof, cl_event event, const char *label)
+{
+        struct profile_record *record;
+        cl_int err;
+
+        if(!prof->enabled || event == NULL)
+                return;
+
+        if(prof->count == prof->capacity) {
+                size_t capacity = (prof->capacity > 0) ? prof->capacity * 2 : 64;
+                struct profile_record *records = realloc(prof->records, capacity * sizeof(*records));
+                if(records == NULL) {
+                        printf("Error: Out of memory recording profiling events\n");
+                        exit(1);
+                }
+                prof->records = records;
+                prof->capacity = capacity;
+        }
+
+        record = &prof->records[prof->count++];
+        memset(record, 0, sizeof(*record));
+        snprintf(record->label, sizeof(record->label), "%s", (label != NULL) ? label : "");
+        err = clGetEventInfo(event, CL_EVENT_COMMAND_TYPE, sizeof(record->type), &record->type, NULL);
+	ocl_error("Getting event info", err);
+        clRetainEvent(event);
+        record->event = event;
+}
+
+/*
+ * Waits for all recorded events and reads their timestamps.
+ */
+void
+profile_collect(struct profile *prof)
+{
+        cl_int err;
+
+        for(size_t i = 0; i < prof->count; i++) {
+                struct profile_record *record = &prof->records[i];
+                if(record->event == NULL)
+                        continue;
+
+                err  = clWaitForEvents(1, &record->event);
+                err |= clGetEventProfilingInfo(record->event, CL_PROFILING_COMMAND_QUEUED,
+                                               sizeof(cl_ulong), &record->queued, NULL);
+                err |= clGetEventProfilingInfo(record->event, CL_PROFILING_COMMAND_SUBMIT,
+                                               sizeof(cl_ulong), &record->submit, NULL);
+                err |= clGetEventProfilingInfo(record->event, CL_PROFILING_COMMAND_START,
+                                               sizeof(cl_ulong), &record->start, NULL);
+                err |= clGetEventProfilingInfo(record->event, CL_PROFILING_COMMAND_END,
+                                               sizeof(cl_ulong), &record->end, NULL);
+		ocl_error("Getting event profiling info", err);
+
+                clReleaseEvent(record->event);
+                record->event = NULL;
+        }
+}
+
+const char *
+profile_command_name(cl_command_type type)
+{
+        switch(type) {
+        case CL_COMMAND_NDRANGE_KERNEL:         return "kernel";
+        case CL_COMMAND_TASK:                   return "task";
+        case CL_COMMAND_READ_BUFFER:            return "read";
+        case CL_COMMAND_WRITE_BUFFER:           return "write";
+        case CL_COMMAND_COPY_BUFFER:            return "copy";
+        case CL_COMMAND_MAP_BUFFER:             return "map";
+        case CL_COMMAND_UNMAP_MEM_OBJECT:       return "unmap";
+        case CL_COMMAND_READ_BUFFER_RECT:       return "read_rect";
+        case CL_COMMAND_WRITE_BUFFER_RECT:      return "write_rect";
+        case CL_COMMAND_COPY_BUFFER_RECT:       return "copy_rect";
+        case CL_COMMAND_MARKER:                 return "marker";
+        default:                                return "other";
+        }
+}
+
+/*
+ * Aggregates the collected records of one command type.
+ */
+static void
+profile_summarize(const struct profile *prof, cl_command_type type, struct profile_summary *summary)
+{
+        memset(summary, 0, sizeof(*summary));
+        summary->type = type;
+
+        for(size_t i = 0; i < prof->count; i++) {
+                const struct profile_record *record = &prof->records[i];
+                if(record->type != type)
+                        continue;
+
+                double exec = (record->end - record->start) * 1e-6;
+                double wait = (record->start - record->queued) * 1e-6;
+                if(summary->count == 0 || exec < summary->min_ms)
+                        summary->min_ms = exec;
+                if(summary->count == 0 || exec > summary->max_ms)
+                        summary->max_ms = exec;
+                summary->total_ms += exec;
+                summary->wait_ms += wait;
+                summary->count++;
+        }
+}
+
+/*
+ * Returns the summaries of all command types seen, in first-seen order.
+ */
+static size_t
+profile_summaries(const struct profile *prof, struct profile_summary *summaries, size_t max)
+{
+        size_t num = 0;
+
+        for(size_t i = 0; i < prof->count && num < max; i++) {
+                size_t j;
+                for(j = 0; j < num; j++) {
+                        if(summaries[j].type == prof->records[i].type)
+                                break;
+                }
+                if(j == num)
+                        profile_summarize(prof, prof->records[i].type, &summaries[num++]);
+        }
+        return num;
+}
+
+void
+profile_print(struct profile *prof, FILE *out)
+{
+        struct profile_summary summaries[PROFILE_MAX_TYPES];
+        size_t num;
+        double total = 0.0;
+
+        profile_collect(prof);
+        num = profile_summaries(prof, summaries, PROFILE_MAX_TYPES);
+        for(size_t i = 0; i < num; i++)
+                total += summaries[i].total_ms;
+
+        fprintf(out, "%-10s %8s %12s %12s %12s %12s %12s %7s\n",
+                "Command", "Count", "Total(ms)", "Avg(ms)", "Min(ms)", "Max(ms)", "AvgWait(ms)", "Share");
+        for(size_t i = 0; i < num; i++) {
+                const struct profile_summary *s = &summaries[i];
+                fprintf(out, "%-10s %8lu %12.3f %12.3f %12.3f %12.3f %12.3f %6.1f%%\n",
+                        profile_command_name(s->type), (unsigned long)s->count, s->total_ms,
+                        s->total_ms / s->count, s->min_ms, s->max_ms, s->wait_ms / s->count,
+                        (total > 0.0) ? 100.0 * s->total_ms / total : 0.0);
+        }
+}
+
+/*
+ * Writes every record and the per-type summary as JSON. Timestamps are in
+ * nanoseconds relative to the first queued command.
+ */
+void
+profile_dump_json(struct profile *prof, FILE *out)
+{
+        struct profile_summary summaries[PROFILE_MAX_TYPES];
+        size_t num;
+        cl_ulong base = 0;
+
+        profile_collect(prof);
+        for(size_t i = 0; i < prof->count; i++) {
+                if(i == 0 || prof->records[i].queued < base)
+                        base = prof->records[i].queued;
+        }
+
+        fprintf(out, "{\n  \"commands\": [\n");
+        for(size_t i = 0; i < prof->count; i++) {
+                const struct profile_record *r = &prof->records[i];
+                fprintf(out, "    {\"type\": \"%s\", \"label\": \"%s\", \"queued\": %llu, \"submit\": %llu, "
+                        "\"start\": %llu, \"end\": %llu}%s\n",
+                        profile_command_name(r->type), r->label,
+                        (unsigned long long)(r->queued - base), (unsigned long long)(r->submit - base),
+                        (unsigned long long)(r->start - base), (unsigned long long)(r->end - base),
+                        (i + 1 < prof->count) ? "," : "");
+        }
+        fprintf(out, "  ],\n  \"summary\": [\n");
+
+        num = profile_summaries(prof, summaries, PROFILE_MAX_TYPES);
+        for(size_t i = 0; i < num; i++) {
+                const struct profile_summary *s = &summaries[i];
+                fprintf(out, "    {\"type\": \"%s\", \"count\": %lu, \"total_ms\": %.6f, \"min_ms\": %.6f, "
+                        "\"max_ms\": %.6f, \"avg_wait_ms\": %.6f, \"total_wait_ms\": %.6f}%s\n",
+                        profile_command_name(s->type), (unsigned long)s->count, s->total_ms,
+                        s->min_ms, s->max_ms, s->wait_ms / s->count, s->wait_ms, (i + 1 < num) ? "," : "");
+        }
+        fprintf(out, "  ]\n}\n");
+}
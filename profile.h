@@ -0,0 +1,42 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+#include "CL/cl.h"
+
+#define PROFILE_MAX_TYPES (16)
+
+struct profile_record {
+        cl_command_type type;
+        char label[64];
+        cl_event event;			// pending until profile_collect()
+        cl_ulong queued, submit, start, end;
+};
+
+struct profile_summary {
+        cl_command_type type;
+        size_t count;
+        double total_ms, min_ms, max_ms;	// execution time, end - start
+        double wait_ms;				// summed queue latency, start - queued
+};
+
+/*
+ * Timestamps of commands run on a queue created with
+ * CL_QUEUE_PROFILING_ENABLE.
+ */
+struct profile {
+        int enabled;
+        size_t count, capacity;
+        struct profile_record *records;
+};
+
+void profile_init(struct profile *prof, int enabled);
+void profile_release(struct profile *prof);
+void profile_event(struct profile *prof, cl_event event, const char *label);
+void profile_collect(struct profile *prof);
+const char *profile_command_name(cl_command_type type);
+void profile_print(struct profile *prof, FILE *out);
+void profile_dump_json(struct profile *prof, FILE *out);
+
+#endif //PROFILE_H
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "reduce.h"
+#include "util.h"
+
+static const char *reduce_kernel_names[REDUCE_OP_COUNT] = { "reduce_sum", "reduce_min", "reduce_max" };
+
+
+/*
+ * Number of first-pass work-groups: enough to keep every compute unit busy,
+ * few enough that the final pass is a single small work-group.
+ */
+static size_t
+reduce_groups(struct ocl_runtime *rt, size_t count, size_t local)
+{
+        cl_int err;
+        cl_uint compute_units;
+        size_t groups = (count + local - 1) / local;
+
+        err = clGetDeviceInfo(rt->device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+	ocl_error("Unable to get device info", err);
+        if(groups > (size_t)compute_units * REDUCE_GROUPS_PER_CU)
+                groups = (size_t)compute_units * REDUCE_GROUPS_PER_CU;
+        return (groups > 0) ? groups : 1;
+}
+
+/*
+ * Runs one reduction pass of 'groups' work-groups of 'local' work-items. The
+ * kernel takes 'num_bufs' buffers, then the count, then one __local array of
+ * 'local' elements per entry of 'scratch_sizes'.
+ */
+static void
+reduce_pass(struct ocl_runtime *rt, cl_kernel kernel, const cl_mem *bufs, unsigned int num_bufs, cl_ulong count,
+            const size_t *scratch_sizes, unsigned int num_scratch, size_t groups, size_t local)
+{
+        cl_int err = CL_SUCCESS;
+        cl_event event;
+        size_t global = groups * local;
+        cl_uint arg = 0;
+
+        for(unsigned int i = 0; i < num_bufs; i++)
+                err |= clSetKernelArg(kernel, arg++, sizeof(cl_mem), &bufs[i]);
+        err |= clSetKernelArg(kernel, arg++, sizeof(cl_ulong), &count);
+        for(unsigned int i = 0; i < num_scratch; i++)
+                err |= clSetKernelArg(kernel, arg++, scratch_sizes[i] * local, NULL);
+	ocl_error("Setting reduction kernel arguments", err);
+
+        err = clEnqueueNDRangeKernel(rt->queue, kernel, 1, NULL, &global, &local, 0, NULL, &event);
+	ocl_error("Enqueueing reduction", err);
+        profile_event(&rt->profile, event, "reduce");
+        clReleaseEvent(event);
+}
+
+/*
+ * Returns the sum, minimum or maximum of the first 'count' floats of 'input'
+ * (0, +inf and -inf for an empty input). Only the result is read back.
+ */
+float
+reduce_float(struct ocl_runtime *rt, enum reduce_op op, cl_mem input, size_t count)
+{
+        cl_int err;
+        cl_kernel kernel = opencl_require_kernel(rt, "reduce.cl", reduce_kernel_names[op]);
+        size_t scratch = sizeof(cl_float);
+        size_t local = opencl_local_size(rt, kernel, REDUCE_LOCAL);
+        size_t groups = reduce_groups(rt, count, local);
+        cl_mem bufs[2];
+        cl_mem partial = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_float) * groups);
+        cl_mem result = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_float));
+        float value;
+
+        bufs[0] = input;
+        bufs[1] = (groups > 1) ? partial : result;
+        reduce_pass(rt, kernel, bufs, 2, count, &scratch, 1, groups, local);
+        if(groups > 1) {
+                bufs[0] = partial;
+                bufs[1] = result;
+                reduce_pass(rt, kernel, bufs, 2, groups, &scratch, 1, 1, local);
+        }
+
+        err = clEnqueueReadBuffer(rt->queue, result, CL_TRUE, 0, sizeof(value), &value, 0, NULL, NULL);
+	ocl_error("Reading reduction result", err);
+
+        bufpool_release(&rt->pool, partial);
+        bufpool_release(&rt->pool, result);
+        return value;
+}
+
+/*
+ * Returns the index of the largest of the first 'count' floats of 'input',
+ * the lowest one if several are equal, and stores the value in '*max' if not
+ * NULL. NaNs are ignored; without any other value (size_t)-1 is returned.
+ */
+size_t
+reduce_argmax(struct ocl_runtime *rt, cl_mem input, size_t count, float *max)
+{
+        cl_int err;
+        cl_kernel first = opencl_require_kernel(rt, "reduce.cl", "reduce_argmax");
+        cl_kernel pairs = opencl_require_kernel(rt, "reduce.cl", "reduce_argmax_pairs");
+        size_t scratch[2] = { sizeof(cl_float), sizeof(cl_ulong) };
+        size_t local = opencl_local_size(rt, first, REDUCE_LOCAL);
+        size_t groups;
+        cl_mem bufs[4];
+        cl_mem partial, partial_index, result, result_index;
+        cl_float value;
+        cl_ulong index;
+
+        // Both passes use the same local size, so it must suit both kernels
+        if(opencl_local_size(rt, pairs, REDUCE_LOCAL) < local)
+                local = opencl_local_size(rt, pairs, REDUCE_LOCAL);
+        groups = reduce_groups(rt, count, local);
+
+        partial = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_float) * groups);
+        partial_index = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_ulong) * groups);
+        result = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_float));
+        result_index = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_ulong));
+
+        bufs[0] = input;
+        bufs[1] = (groups > 1) ? partial : result;
+        bufs[2] = (groups > 1) ? partial_index : result_index;
+        reduce_pass(rt, first, bufs, 3, count, scratch, 2, groups, local);
+        if(groups > 1) {
+                bufs[0] = partial;
+                bufs[1] = partial_index;
+                bufs[2] = result;
+                bufs[3] = result_index;
+                reduce_pass(rt, pairs, bufs, 4, groups, scratch, 2, 1, local);
+        }
+
+        err  = clEnqueueReadBuffer(rt->queue, result, CL_FALSE, 0, sizeof(value), &value, 0, NULL, NULL);
+        err |= clEnqueueReadBuffer(rt->queue, result_index, CL_TRUE, 0, sizeof(index), &index, 0, NULL, NULL);
+	ocl_error("Reading reduction result", err);
+
+        bufpool_release(&rt->pool, partial);
+        bufpool_release(&rt->pool, partial_index);
+        bufpool_release(&rt->pool, result);
+        bufpool_release(&rt->pool, result_index);
+
+        if(max != NULL)
+                *max = value;
+        return (index == CL_ULONG_MAX) ? (size_t)-1 : (size_t)index;
+}
@@ -0,0 +1,103 @@
+/*
+ * Work-group reductions. Every kernel reduces 'count' values to one partial
+ * result per work-group: each work-item first folds a grid-strided slice of
+ * the input in registers, then the work-group combines those in __local
+ * memory as a tree. Launched once with many work-groups and once more with a
+ * single work-group over the partials, which leaves the result in element 0.
+ * The local size must be a power of two.
+ */
+
+#define REDUCE_ADD(a, b) ((a) + (b))
+
+#define REDUCE(NAME, IDENTITY, OP)                                                              \
+__kernel void reduce_##NAME(__global const float* input, __global float* partial,               \
+                            const ulong count, __local float* scratch)                          \
+{                                                                                               \
+   size_t lid = get_local_id(0);                                                                \
+   size_t stride = get_global_size(0);                                                          \
+   float acc = IDENTITY;                                                                        \
+                                                                                                \
+   for(size_t i = get_global_id(0); i < count; i += stride)                                     \
+       acc = OP(acc, input[i]);                                                                 \
+   scratch[lid] = acc;                                                                          \
+   barrier(CLK_LOCAL_MEM_FENCE);                                                                \
+                                                                                                \
+   for(size_t s = get_local_size(0) / 2; s > 0; s /= 2) {                                       \
+       if(lid < s)                                                                              \
+           scratch[lid] = OP(scratch[lid], scratch[lid + s]);                                   \
+       barrier(CLK_LOCAL_MEM_FENCE);                                                            \
+   }                                                                                            \
+   if(lid == 0)                                                                                 \
+       partial[get_group_id(0)] = scratch[0];                                                   \
+}
+
+REDUCE(sum, 0.0f, REDUCE_ADD)
+REDUCE(min, INFINITY, fmin)
+REDUCE(max, -INFINITY, fmax)
+
+/*
+ * Largest value and its index, the lowest index among equal values. NaNs
+ * never win, so an input of only NaNs yields index ULONG_MAX.
+ */
+#define ARGMAX_BETTER(v, i, best_v, best_i) ((v) > (best_v) || ((v) == (best_v) && (i) < (best_i)))
+
+void argmax_tree(__local float* scratch, __local ulong* scratch_index, float best, ulong best_index,
+                 __global float* partial, __global ulong* partial_index)
+{
+   size_t lid = get_local_id(0);
+
+   scratch[lid] = best;
+   scratch_index[lid] = best_index;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   for(size_t s = get_local_size(0) / 2; s > 0; s /= 2) {
+       if(lid < s && ARGMAX_BETTER(scratch[lid + s], scratch_index[lid + s], scratch[lid], scratch_index[lid])) {
+           scratch[lid] = scratch[lid + s];
+           scratch_index[lid] = scratch_index[lid + s];
+       }
+       barrier(CLK_LOCAL_MEM_FENCE);
+   }
+   if(lid == 0) {
+       partial[get_group_id(0)] = scratch[0];
+       partial_index[get_group_id(0)] = scratch_index[0];
+   }
+}
+
+/*
+ * First pass: the index of every value is its position in 'input'.
+ */
+__kernel void reduce_argmax(__global const float* input, __global float* partial, __global ulong* partial_index,
+                            const ulong count, __local float* scratch, __local ulong* scratch_index)
+{
+   size_t stride = get_global_size(0);
+   float best = -INFINITY;
+   ulong best_index = ULONG_MAX;
+
+   for(size_t i = get_global_id(0); i < count; i += stride) {
+       if(ARGMAX_BETTER(input[i], i, best, best_index)) {
+           best = input[i];
+           best_index = i;
+       }
+   }
+   argmax_tree(scratch, scratch_index, best, best_index, partial, partial_index);
+}
+
+/*
+ * Final pass over the (value, index) pairs left by reduce_argmax.
+ */
+__kernel void reduce_argmax_pairs(__global const float* input, __global const ulong* input_index,
+                                  __global float* partial, __global ulong* partial_index,
+                                  const ulong count, __local float* scratch, __local ulong* scratch_index)
+{
+   size_t stride = get_global_size(0);
+   float best = -INFINITY;
+   ulong best_index = ULONG_MAX;
+
+   for(size_t i = get_global_id(0); i < count; i += stride) {
+       if(ARGMAX_BETTER(input[i], input_index[i], best, best_index)) {
+           best = input[i];
+           best_index = input_index[i];
+       }
+   }
+   argmax_tree(scratch, scratch_index, best, best_index, partial, partial_index);
+}
@@ -0,0 +1,23 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+#define REDUCE_LOCAL (256)		// largest work-group size used
+#define REDUCE_GROUPS_PER_CU (4)	// first-pass work-groups per compute unit
+
+enum reduce_op {
+        REDUCE_SUM,
+        REDUCE_MIN,
+        REDUCE_MAX,
+        REDUCE_OP_COUNT
+};
+
+float reduce_float(struct ocl_runtime *rt, enum reduce_op op, cl_mem input, size_t count);
+size_t reduce_argmax(struct ocl_runtime *rt, cl_mem input, size_t count, float *max);
+
+#endif //REDUCE_H
@@ -1,102 +1,1016 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "CL/cl.h"
 
+#include "async.h"
+#include "buffer.h"
+#include "calibrate.h"
+#include "filter.h"
+#include "histogram.h"
+#include "hostexec.h"
+#include "multidev.h"
 #include "opencl.h"
+#include "reduce.h"
+#include "scan.h"
+#include "sort.h"
+#include "stencil.h"
+#include "square.h"
+#include "stream.h"
+#include "transpose.h"
+#include "tune.h"
 #include "util.h"
 
 #define DATA_SIZE (1024)
+#define ASYNC_JOBS (4)
 
-int main()
+static void
+usage(const char *name)
 {
-        cl_int err;                         // error code returned from api calls
-        size_t global;                      // global domain size for our calculation
-        size_t local;                       // local domain size for our calculation
-        cl_device_id device_id;             // device id running computation
-        cl_context context;                 // compute context
-        cl_command_queue queue;             // compute command queue
-        cl_kernel kernel;                   // compute kernel
+        printf("Usage: %s [-b] [-p] [-j file] [-n count] [-i file] [-s] [-m] [-a] [-w width] [-f] [-r] [-g bins]"
+               " [-o] [-t threshold [-q]] [-e] [-l] [-x]\n", name);
+        printf("  -b        select the device by benchmark instead of by static score\n");
+        printf("  -p        profile every command and print a summary\n");
+        printf("  -j file   profile and write the per-command timings to 'file' as JSON\n");
+        printf("  -n count  number of elements to square (default %d)\n", DATA_SIZE);
+        printf("  -i file   square the raw floats in 'file' instead of random values\n");
+        printf("  -s        stream the data through the device in overlapping chunks\n");
+        printf("  -m        split the data across every available device\n");
+        printf("  -w width  floats per work-item in the single pass (default: from the device)\n");
+        printf("  -f        build the single pass for exactly 'count' elements\n");
+        printf("  -r        also reduce the results on the device (sum, min, max, argmax)\n");
+        printf("  -g bins   also bin the results in [0, 1] on the device into 'bins' bins\n");
+        printf("  -o        sort the results on the device before reading them back\n");
+        printf("  -t value  only read back the results above 'value', filtered on the device\n");
+        printf("  -q        with -t, compile the comparison in as a generated predicate expression\n");
+        printf("  -a        submit the data as %d asynchronous jobs kept in flight together\n", ASYNC_JOBS);
+        printf("  -e        check 1D, 2D and 3D stencils on the device against the host\n");
+        printf("  -l        check the transpose and AoS/SoA conversions on the device against the host\n");
+        printf("  -x        check exclusive and inclusive int, uint and float scans against the host\n");
+}
 
-        cl_mem input;                       // device memory used for the input array
-        cl_mem output;                      // device memory used for the output array
+/*
+ * Returns the number of correct results.
+ */
+static size_t
+validate(const float *data, const float *results, size_t count)
+{
+        size_t correct = 0;
 
-        float data[DATA_SIZE];              // original data set given to device
-        float results[DATA_SIZE];           // results returned from device
-        unsigned int correct;               // number of correct results returned
+        for(size_t i = 0; i < count; i++) {
+                if(results[i] == data[i] * data[i])
+                        correct++;
+                else
+                        printf("[%lu]: %f^2 == %f, != %f\n", (unsigned long)i, data[i], data[i] * data[i], results[i]);
+        }
+        return correct;
+}
 
+/*
+ * 'count' random values in page-aligned memory.
+ */
+static float *
+random_data(size_t count)
+{
+        float *data = host_alloc(sizeof(float) * count);
 
-        // Fill our data set with random values
-        unsigned int i = 0;
-		unsigned int count = DATA_SIZE;
-		for(i = 0; i < count; i++)
-		    data[i] = (float) (rand() / (float)RAND_MAX);
+        for(size_t i = 0; i < count; i++)
+                data[i] = (float) (rand() / (float)RAND_MAX);
+        return data;
+}
 
-        setup_opencl("square.cl", "square", &device_id, &kernel, &context, &queue);
+/*
+ * Maps the native-endian floats stored in 'filename'. '*count' is capped to
+ * the number of floats in the file.
+ */
+static const float *
+input_data(const char *filename, struct mapped_file *file, size_t *count)
+{
+        size_t floats;
 
-        // Get the maximum work group size for executing the kernel on the device
-        err = clGetKernelWorkGroupInfo(kernel, device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(local), &local, NULL);
-        if (err != CL_SUCCESS) {
-                printf("Error: Failed to retrieve kernel work group info: %s\n", ocl_error_string(err));
+        if(!map_file(filename, file))
+                exit(1);
+        floats = file->size / sizeof(float);
+        if(floats == 0) {
+                printf("Error: %s holds no floats\n", filename);
                 exit(1);
         }
+        if(*count == 0 || *count > floats)
+                *count = floats;
+        return file->data;
+}
 
-        // Create the input and output arrays in device memory for our calculation
-        input = clCreateBuffer(context,  CL_MEM_READ_ONLY,  sizeof(float) * count, NULL, &err);
-        if (err != CL_SUCCESS) {
-                printf("Error: Failed to allocate device READ memory: %s\n", ocl_error_string(err));
-                exit(1);
+struct reductions {
+        double sum;
+        float min, max;
+        size_t argmax;
+};
+
+/*
+ * Reductions of 'count' floats on the device, reading back only the scalars.
+ */
+static void
+device_reductions(struct ocl_runtime *rt, cl_mem values, size_t count, struct reductions *r)
+{
+        r->sum = reduce_float(rt, REDUCE_SUM, values, count);
+        r->min = reduce_float(rt, REDUCE_MIN, values, count);
+        r->max = reduce_float(rt, REDUCE_MAX, values, count);
+        r->argmax = reduce_argmax(rt, values, count, NULL);
+}
+
+static void
+host_reductions(const float *values, size_t count, struct reductions *r)
+{
+        r->sum = 0.0;
+        r->min = INFINITY;
+        r->max = -INFINITY;
+        r->argmax = (size_t)-1;
+        for(size_t i = 0; i < count; i++) {
+                r->sum += values[i];
+                r->min = fminf(r->min, values[i]);
+                if(values[i] > r->max || (values[i] == r->max && r->argmax == (size_t)-1)) {
+                        r->max = values[i];
+                        r->argmax = i;
+                }
         }
-        output = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * count, NULL, &err);
-        if (err != CL_SUCCESS) {
-                printf("Error: Failed to allocate device WRITE memory: %s\n", ocl_error_string(err));
-                exit(1);
+}
+
+/*
+ * Prints the device reductions and returns whether they agree with the host.
+ * The sums may differ in the last bits, as they add in a different order.
+ */
+static int
+print_reductions(const struct reductions *device, const struct reductions *host)
+{
+        int sum_ok = fabs(device->sum - host->sum) <= 1e-4 * fabs(host->sum) + 1e-6;
+        int min_ok = device->min == host->min;
+        int max_ok = device->max == host->max && device->argmax == host->argmax;
+
+        printf("Sum: %g%s\n", device->sum, sum_ok ? "" : " (host differs)");
+        printf("Min: %g%s\n", device->min, min_ok ? "" : " (host differs)");
+        printf("Max: %g at %lu%s\n", device->max, (unsigned long)device->argmax, max_ok ? "" : " (host differs)");
+        return sum_ok && min_ok && max_ok;
+}
+
+/*
+ * Bins 'count' floats in [0, 1] into 'bins' bins on the host, like
+ * histogram_float().
+ */
+static void
+host_histogram(const float *values, size_t count, unsigned int bins, cl_uint *counts)
+{
+        memset(counts, 0, sizeof(cl_uint) * bins);
+        for(size_t i = 0; i < count; i++) {
+                float f = values[i] * bins;
+                if(f >= 0.0f && f <= bins)
+                        counts[(f < bins) ? (unsigned int)f : bins - 1]++;
         }
+}
+
+/*
+ * Prints the device histogram and returns whether it agrees with the host.
+ */
+static int
+print_histogram(const cl_uint *device, const cl_uint *host, unsigned int bins)
+{
+        int same = memcmp(device, host, sizeof(cl_uint) * bins) == 0;
+
+        printf("Histogram of [0, 1] in %u bins%s:", bins, same ? "" : " (host differs)");
+        for(unsigned int b = 0; b < bins; b++)
+                printf(" %u", device[b]);
+        printf("\n");
+        return same;
+}
+
+static void
+release_data(const float *data, struct mapped_file *file)
+{
+        if(file->data != NULL)
+                unmap_file(file);
+        else
+                free((float *)data);
+}
+
+/*
+ * Squares 'count' values in a single pass, with the whole data set resident
+ * in device memory, 'width' values per work-item. With 'fixed' the kernel is
+ * compiled for this very count, with 'reduce' the results are also reduced
+ * on the device and with 'bins' they are binned there. A reduction or
+ * histogram that disagrees with the host counts every value as incorrect.
+ */
+static size_t
+square_resident(struct ocl_runtime *rt, unsigned int width, int fixed, int reduce, unsigned int bins,
+                const float *data, size_t count)
+{
+        cl_kernel kernel;                   // compute kernel
+        size_t work_items;                  // work-items covering the data set
+        cl_int err;                         // error code returned from api calls
+        size_t global;                      // global domain size for our calculation
+        size_t local;                       // local domain size for our calculation
+        cl_event event;                     // event of the last enqueued command
+
+        struct ocl_buffer input;            // device memory used for the input array
+        struct ocl_buffer output;           // device memory used for the output array
+
+        float *results;                     // results returned from device
+        cl_ulong count_arg = count;         // the kernel's 64-bit element count
+        size_t correct;                     // number of correct results returned
+        struct reductions device, host;     // reductions of the results
+        cl_uint *device_bins = NULL;        // histograms of the results
+        cl_uint *host_bins = NULL;
+        int agree = 1;                      // reductions and histogram match the host
 
-	// Write our data set into the input array in device memory 
-	err = clEnqueueWriteBuffer(queue, input, CL_TRUE, 0, sizeof(float) * count, data, 0, NULL, NULL);
-	if (err != CL_SUCCESS) {
-		printf("Error: Failed to write to source array: %s\n", ocl_error_string(err));
-		exit(1);
-	}
+        // Create the input and output arrays in device memory for our calculation.
+        // On devices sharing memory with the host the input array is the data
+        // set itself (page-aligned, or a mapped file) and the output is mapped,
+        // neither is copied; elsewhere the input is uploaded once, profiled as
+        // "input". The kernel only reads the input.
+        buffer_wrap(rt, &input, CL_MEM_READ_ONLY, (float *)data, sizeof(float) * count, "input");
+        buffer_create(rt, &output, (reduce || bins) ? CL_MEM_READ_WRITE : CL_MEM_WRITE_ONLY, sizeof(float) * count);
+
+        if(fixed) {
+                kernel = square_fixed_kernel(rt, width, count);
+                work_items = square_fixed_work_items(count, width);
+        } else {
+                kernel = square_kernel(rt, width);
+                work_items = square_work_items(count, width);
+        }
 
         // Set the arguments to our compute kernel
-        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
-        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
-        err |= clSetKernelArg(kernel, 2, sizeof(unsigned int), &count);
+        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input.mem);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output.mem);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_ulong), &count_arg);
         if (err != CL_SUCCESS) {
                 printf("Error: Failed to set kernel arguments: %s\n", ocl_error_string(err));
                 exit(1);
         }
 
         // Execute the kernel over the entire range of our 1d input data set
-        // using the maximum number of work group items for this device
-        global = count;
-        err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global, &local, 0, NULL, NULL);
+        // using the tuned work group size for this device, with the global
+        // size padded to a multiple of it. The kernel ignores the padding.
+        // Ranges too large for one launch are split into several.
+        tune_local_size(rt, kernel, work_items, &local, &global);
+        err = opencl_enqueue_range(rt->queue, kernel, global, local, 0, NULL, &event);
         if (err != CL_SUCCESS) {
                 printf("Error: Failed to execute kernel: %s\n", ocl_error_string(err));
-                return EXIT_FAILURE;
+                exit(1);
         }
+        profile_event(&rt->profile, event, "square");
+        clReleaseEvent(event);
 
-        // Wait for the command commands to get serviced before reading back results
-        clFinish(queue);
+        // Reduce and bin the results where they are, before they are mapped
+        if(reduce)
+                device_reductions(rt, output.mem, count, &device);
+        if(bins) {
+                device_bins = malloc(sizeof(cl_uint) * bins);
+                host_bins = malloc(sizeof(cl_uint) * bins);
+                if(device_bins == NULL || host_bins == NULL) {
+                        printf("Error: Out of memory for %u bins\n", bins);
+                        exit(1);
+                }
+                histogram_float(rt, output.mem, count, 0.0f, 1.0f, bins, device_bins);
+        }
 
-        // Read back the results from the device to verify the output
-        err = clEnqueueReadBuffer(queue, output, CL_TRUE, 0, sizeof(float) * count, results, 0, NULL, NULL );
-        if (err != CL_SUCCESS) {
-                printf("Error: Failed to read output array: %s\n", ocl_error_string(err));
+        // Read back the results from the device to verify the output.
+        // The blocking map waits for the kernel, no clFinish() needed.
+        results = buffer_map(rt, &output, CL_MAP_READ);
+        buffer_release(rt, &input);
+
+        correct = validate(data, results, count);
+        if(reduce) {
+                host_reductions(results, count, &host);
+                agree &= print_reductions(&device, &host);
+        }
+        if(bins) {
+                host_histogram(results, count, bins, host_bins);
+                agree &= print_histogram(device_bins, host_bins, bins);
+                free(device_bins);
+                free(host_bins);
+        }
+
+        buffer_unmap(rt, &output);
+        buffer_release(rt, &output);
+        return agree ? correct : 0;
+}
+
+/*
+ * Squares 'count' values and compacts the results above 'threshold' on the
+ * device, with the input index of each, so only those cross the bus. With
+ * 'generated' the comparison is compiled in as a predicate expression rather
+ * than picked from the built-in ones. Every input is correct if its result is
+ * read back exactly when it should be.
+ */
+static size_t
+square_filtered(struct ocl_runtime *rt, cl_kernel kernel, float threshold, int generated, const float *data,
+                size_t count)
+{
+        cl_int err;
+        cl_event event;
+        cl_ulong count_arg = count;
+        struct ocl_buffer input, output, matches, indices;
+        unsigned char *seen = calloc(count, 1);
+        cl_uint *index;
+        float *results;
+        size_t num_matches;
+        size_t correct = 0;
+
+        if(seen == NULL) {
+                printf("Error: Unable to filter %lu values\n", (unsigned long)count);
                 exit(1);
         }
 
-        // Validate our results
-        correct = 0;
-        for(i = 0; i < count; i++) {
-                if(results[i] == data[i] * data[i])
+        buffer_wrap(rt, &input, CL_MEM_READ_ONLY, (float *)data, sizeof(float) * count, "input");
+        buffer_create(rt, &output, CL_MEM_READ_WRITE, sizeof(float) * count);
+        buffer_create(rt, &matches, CL_MEM_READ_WRITE, sizeof(float) * count);
+        buffer_create(rt, &indices, CL_MEM_READ_WRITE, sizeof(cl_uint) * count);
+
+        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input.mem);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output.mem);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_ulong), &count_arg);
+        err |= opencl_enqueue_range(rt->queue, kernel, count, 0, 0, NULL, &event);
+	ocl_error("Running square", err);
+        profile_event(&rt->profile, event, "square");
+        clReleaseEvent(event);
+
+        if(generated) {
+                char predicate[64];
+                cl_uint bits;
+
+                // The threshold's bits, exact for any value
+                memcpy(&bits, &threshold, sizeof(bits));
+                snprintf(predicate, sizeof(predicate), "x > as_float(0x%08xU)", bits);
+                num_matches = filter_predicate(rt, FILTER_FLOAT, predicate, output.mem, matches.mem, indices.mem,
+                                               count);
+        } else {
+                num_matches = filter_run(rt, FILTER_FLOAT, FILTER_GREATER, &threshold, output.mem, matches.mem,
+                                         indices.mem, count);
+        }
+
+        // Read back only the matches, zero-sized reads are invalid
+        results = host_alloc(sizeof(float) * (num_matches + 1));
+        index = host_alloc(sizeof(cl_uint) * (num_matches + 1));
+        if(num_matches > 0) {
+                err  = clEnqueueReadBuffer(rt->queue, matches.mem, CL_FALSE, 0, sizeof(float) * num_matches,
+                                           results, 0, NULL, NULL);
+                err |= clEnqueueReadBuffer(rt->queue, indices.mem, CL_TRUE, 0, sizeof(cl_uint) * num_matches,
+                                           index, 0, NULL, NULL);
+		ocl_error("Reading filtered results", err);
+        }
+
+        for(size_t i = 0; i < num_matches; i++) {
+                if(index[i] < count && !seen[index[i]] && results[i] == data[index[i]] * data[index[i]] &&
+                   (i == 0 || index[i - 1] < index[i])) {
+                        seen[index[i]] = 1;
+                } else {
+                        printf("[%lu]: %f from index %u is out of place\n", (unsigned long)i, results[i], index[i]);
+                }
+        }
+        for(size_t i = 0; i < count; i++) {
+                if(seen[i] == (data[i] * data[i] > threshold))
                         correct++;
                 else
-                        printf("[%d]: %f^2 == %f, != %f\n", i, data[i], data[i] * data[i], results[i]);
+                        printf("[%lu]: %f^2 == %f, %s\n", (unsigned long)i, data[i], data[i] * data[i],
+                               seen[i] ? "not above the threshold" : "missing");
         }
+        printf("Read back %lu of %lu results above %g\n", (unsigned long)num_matches, (unsigned long)count,
+               threshold);
+
+        buffer_release(rt, &input);
+        buffer_release(rt, &output);
+        buffer_release(rt, &matches);
+        buffer_release(rt, &indices);
+        free(results);
+        free(index);
+        free(seen);
+        return correct;
+}
+
+/*
+ * A pooled device buffer holding a copy of 'size' bytes of 'host'.
+ */
+static cl_mem
+device_copy(struct ocl_runtime *rt, const void *host, size_t size)
+{
+        cl_mem mem = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, size);
+        cl_int err = clEnqueueWriteBuffer(rt->queue, mem, CL_TRUE, 0, size, host, 0, NULL, NULL);
+	ocl_error("Writing check input", err);
+        return mem;
+}
+
+static void
+device_read(struct ocl_runtime *rt, cl_mem mem, void *host, size_t size)
+{
+        cl_int err = clEnqueueReadBuffer(rt->queue, mem, CL_TRUE, 0, size, host, 0, NULL, NULL);
+	ocl_error("Reading check output", err);
+}
+
+/*
+ * Counts the device results within a relative 'tolerance' of the host's, as
+ * the device may contract multiplies and adds or sum in another order,
+ * prints them under 'label' and returns whether all of them are.
+ */
+static int
+check_close(const char *label, const float *device, const float *host, size_t count, float tolerance)
+{
+        size_t correct = 0;
+
+        for(size_t i = 0; i < count; i++) {
+                if(fabsf(device[i] - host[i]) <= tolerance * fmaxf(fabsf(host[i]), 1.0f))
+                        correct++;
+                else if(correct + 10 > i)
+                        printf("[%lu]: %f != %f\n", (unsigned long)i, device[i], host[i]);
+        }
+        printf("%s: '%lu/%lu' correct values\n", label, (unsigned long)correct, (unsigned long)count);
+        return correct == count;
+}
+
+/*
+ * One timestep of a stencil on the host, summing in the same order as the
+ * generated kernel.
+ */
+static void
+host_stencil(unsigned int dims, unsigned int radius, const float *coefficients, float boundary,
+             const size_t *size, const float *input, float *output)
+{
+        int r[STENCIL_MAX_DIMS] = { 0, 0, 0 };
+        long n[STENCIL_MAX_DIMS] = { 1, 1, 1 };
+
+        for(unsigned int d = 0; d < dims; d++) {
+                r[d] = radius;
+                n[d] = size[d];
+        }
+        for(long z = 0; z < n[2]; z++) {
+                for(long y = 0; y < n[1]; y++) {
+                        for(long x = 0; x < n[0]; x++) {
+                                float sum = 0.0f;
+                                size_t c = 0;
+
+                                for(long dz = -r[2]; dz <= r[2]; dz++) {
+                                        for(long dy = -r[1]; dy <= r[1]; dy++) {
+                                                for(long dx = -r[0]; dx <= r[0]; dx++, c++) {
+                                                        long px = x + dx, py = y + dy, pz = z + dz;
+                                                        int inside = px >= 0 && px < n[0] && py >= 0 &&
+                                                                     py < n[1] && pz >= 0 && pz < n[2];
+                                                        if(coefficients[c] != 0.0f)
+                                                                sum += coefficients[c] *
+                                                                       (inside ? input[(pz * n[1] + py) * n[0] + px]
+                                                                               : boundary);
+                                                }
+                                        }
+                                }
+                                output[(z * n[1] + y) * n[0] + x] = sum;
+                        }
+                }
+        }
+}
+
+/*
+ * Runs a 1D, 2D and 3D stencil over grids that are not a multiple of the
+ * tile, 3 timesteps per launch for 7 timesteps, so the last launch is
+ * partial, and compares each with the host.
+ */
+static int
+check_stencils(struct ocl_runtime *rt)
+{
+        static const float smooth[5] = { 0.1f, 0.2f, 0.4f, 0.2f, 0.1f };
+        static const float diffuse[9] = { 0.0f, 0.1f, 0.0f, 0.1f, 0.6f, 0.1f, 0.0f, 0.1f, 0.0f };
+        float grow[27] = { 0.0f };
+        const struct {
+                unsigned int dims, radius;
+                const float *coefficients;
+                float boundary;
+                size_t size[STENCIL_MAX_DIMS];
+        } cases[] = {
+                { 1, 2, smooth, 0.0f, { 1000, 1, 1 } },
+                { 2, 1, diffuse, 1.0f, { 37, 29, 1 } },
+                { 3, 1, grow, 0.0f, { 13, 11, 9 } },
+        };
+        const unsigned int steps = 3, timesteps = 7;
+        int ok = 1;
+
+        // 3D: a whole-number centre plus the six faces
+        grow[13] = 1.0f;
+        grow[4] = grow[10] = grow[12] = grow[14] = grow[16] = grow[22] = 0.05f;
+
+        for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+                size_t points = cases[i].size[0] * cases[i].size[1] * cases[i].size[2];
+                float *host = random_data(points);
+                float *next = host_alloc(sizeof(float) * points);
+                float *device = host_alloc(sizeof(float) * points);
+                cl_mem grid = device_copy(rt, host, sizeof(float) * points);
+                cl_mem scratch = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(float) * points);
+                struct stencil st;
+                char label[64];
+
+                stencil_create(rt, &st, cases[i].dims, cases[i].radius, cases[i].coefficients, steps,
+                               cases[i].boundary);
+                device_read(rt, stencil_run(rt, &st, cases[i].size, grid, scratch, timesteps), device,
+                            sizeof(float) * points);
+
+                for(unsigned int t = 0; t < timesteps; t++) {
+                        float *swap = host;
+                        host_stencil(cases[i].dims, cases[i].radius, cases[i].coefficients, cases[i].boundary,
+                                     cases[i].size, host, next);
+                        host = next;
+                        next = swap;
+                }
+                snprintf(label, sizeof(label), "Stencil %uD, radius %u, %u steps", cases[i].dims,
+                         cases[i].radius, timesteps);
+                ok &= check_close(label, device, host, points, 1e-5f);
+
+                bufpool_release(&rt->pool, grid);
+                bufpool_release(&rt->pool, scratch);
+                free(host);
+                free(next);
+                free(device);
+        }
+        return ok;
+}
+
+/*
+ * Counts the elements of 'device' equal to 'host', prints them under 'label'
+ * and returns whether all of them are.
+ */
+static int
+check_equal(const char *label, const cl_uint *device, const cl_uint *host, size_t count)
+{
+        size_t correct = 0;
+
+        for(size_t i = 0; i < count; i++) {
+                if(device[i] == host[i])
+                        correct++;
+                else if(correct + 10 > i)
+                        printf("[%lu]: %u != %u\n", (unsigned long)i, device[i], host[i]);
+        }
+        printf("%s: '%lu/%lu' correct values\n", label, (unsigned long)correct, (unsigned long)count);
+        return correct == count;
+}
+
+/*
+ * Transposes a matrix whose edges are not a multiple of the tile, and takes
+ * records of 2, 3 and 4 components from AoS to SoA and back, checking every
+ * layout against the host.
+ */
+static int
+check_layouts(struct ocl_runtime *rt)
+{
+        const size_t rows = 37, cols = 53, records = 1000;
+        size_t size = sizeof(cl_uint) * TRANSPOSE_MAX_COMPONENTS * records;
+        cl_uint *host = host_alloc(size);
+        cl_uint *expected = host_alloc(size);
+        cl_uint *device = host_alloc(size);
+        cl_mem input, output, back;
+        char label[64];
+        int ok = 1;
+
+        for(size_t i = 0; i < TRANSPOSE_MAX_COMPONENTS * records; i++)
+                host[i] = rand();
+
+        input = device_copy(rt, host, sizeof(cl_uint) * rows * cols);
+        output = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_uint) * rows * cols);
+        transpose_run(rt, input, output, rows, cols);
+        device_read(rt, output, device, sizeof(cl_uint) * rows * cols);
+        for(size_t r = 0; r < rows; r++) {
+                for(size_t c = 0; c < cols; c++)
+                        expected[c * rows + r] = host[r * cols + c];
+        }
+        snprintf(label, sizeof(label), "Transpose %lux%lu", (unsigned long)rows, (unsigned long)cols);
+        ok &= check_equal(label, device, expected, rows * cols);
+        bufpool_release(&rt->pool, input);
+        bufpool_release(&rt->pool, output);
+
+        for(unsigned int k = 2; k <= TRANSPOSE_MAX_COMPONENTS; k++) {
+                size_t n = k * records;
+
+                input = device_copy(rt, host, sizeof(cl_uint) * n);
+                output = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_uint) * n);
+                back = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_uint) * n);
+
+                transpose_aos_to_soa(rt, k, input, output, records);
+                transpose_soa_to_aos(rt, k, output, back, records);
+
+                device_read(rt, output, device, sizeof(cl_uint) * n);
+                for(size_t i = 0; i < records; i++) {
+                        for(unsigned int c = 0; c < k; c++)
+                                expected[c * records + i] = host[i * k + c];
+                }
+                snprintf(label, sizeof(label), "AoS to SoA, %u components", k);
+                ok &= check_equal(label, device, expected, n);
+
+                device_read(rt, back, device, sizeof(cl_uint) * n);
+                snprintf(label, sizeof(label), "SoA to AoS, %u components", k);
+                ok &= check_equal(label, device, host, n);
+
+                bufpool_release(&rt->pool, input);
+                bufpool_release(&rt->pool, output);
+                bufpool_release(&rt->pool, back);
+        }
+
+        free(host);
+        free(expected);
+        free(device);
+        return ok;
+}
+
+/*
+ * Scan of 'count' int, uint or float elements on the host, followed by their
+ * total. Float sums are kept in double, int sums wrap like uint ones.
+ */
+static void
+host_scan(int type, int mode, const cl_uint *input, size_t count, cl_uint *output)
+{
+        double fsum = 0.0;
+        cl_uint usum = 0;
+
+        for(size_t i = 0; i <= count; i++) {
+                double fbefore = fsum;
+                cl_uint ubefore = usum;
+                int exclusive = (mode == SCAN_EXCLUSIVE && i < count);
+
+                if(i < count) {
+                        float value;
+                        memcpy(&value, &input[i], sizeof(value));
+                        fsum += value;
+                        usum += input[i];
+                }
+                if(type == SCAN_FLOAT) {
+                        float f = exclusive ? fbefore : fsum;
+                        memcpy(&output[i], &f, sizeof(f));
+                } else {
+                        output[i] = exclusive ? ubefore : usum;
+                }
+        }
+}
+
+/*
+ * Scans every type in both modes over lengths of one element, of several
+ * blocks and of more blocks than one block can hold totals for, so the block
+ * totals are scanned recursively twice. Each total is checked along with the
+ * scan, as one extra element.
+ */
+static int
+check_scans(struct ocl_runtime *rt)
+{
+        static const char *type_names[SCAN_TYPE_COUNT] = { "int", "uint", "float" };
+        static const size_t lengths[] = { 1, 1000, 300000 };
+        const size_t max = 300000;
+        cl_uint *input = host_alloc(sizeof(cl_uint) * max);
+        cl_uint *device = host_alloc(sizeof(cl_uint) * (max + 1));
+        cl_uint *host = host_alloc(sizeof(cl_uint) * (max + 1));
+        char label[64];
+        int ok = 1;
+
+        for(int type = 0; type < SCAN_TYPE_COUNT; type++) {
+                for(size_t i = 0; i < max; i++) {
+                        if(type == SCAN_FLOAT) {
+                                float f = (float) (rand() / (float)RAND_MAX);
+                                memcpy(&input[i], &f, sizeof(f));
+                        } else {
+                                // Signed sums for int, wrapping ones for uint
+                                input[i] = (type == SCAN_INT) ? (cl_uint)(rand() % 2001 - 1000) : (cl_uint)rand();
+                        }
+                }
+
+                for(int mode = SCAN_EXCLUSIVE; mode <= SCAN_INCLUSIVE; mode++) {
+                        for(size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+                                size_t n = lengths[l];
+                                cl_mem in = device_copy(rt, input, sizeof(cl_uint) * n);
+                                cl_mem out = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_uint) * n);
+
+                                scan_run(rt, type, mode, in, out, n, &device[n]);
+                                device_read(rt, out, device, sizeof(cl_uint) * n);
+
+                                host_scan(type, mode, input, n, host);
+
+                                snprintf(label, sizeof(label), "%s %s scan of %lu", type_names[type],
+                                         (mode == SCAN_INCLUSIVE) ? "inclusive" : "exclusive", (unsigned long)n);
+                                if(type == SCAN_FLOAT)
+                                        ok &= check_close(label, (float *)device, (float *)host, n + 1, 1e-4f);
+                                else
+                                        ok &= check_equal(label, device, host, n + 1);
+
+                                bufpool_release(&rt->pool, in);
+                                bufpool_release(&rt->pool, out);
+                        }
+                }
+        }
+
+        free(input);
+        free(device);
+        free(host);
+        return ok;
+}
+
+/*
+ * Squares 'count' values and sorts the results on the device, carrying each
+ * result's input index along, so only the sorted data is read back.
+ */
+static size_t
+square_sorted(struct ocl_runtime *rt, cl_kernel kernel, const float *data, size_t count)
+{
+        cl_int err;
+        cl_event event;
+        cl_ulong count_arg = count;
+        struct ocl_buffer input, output, indices;
+        cl_uint *index = host_alloc(sizeof(cl_uint) * count);
+        unsigned char *seen = calloc(count, 1);
+        cl_uint *order;
+        float *results;
+        size_t correct = 0;
+
+        if(seen == NULL || count > 0xffffffffUL) {
+                printf("Error: Unable to sort %lu values\n", (unsigned long)count);
+                exit(1);
+        }
+        for(size_t i = 0; i < count; i++)
+                index[i] = i;
+
+        buffer_wrap(rt, &input, CL_MEM_READ_ONLY, (float *)data, sizeof(float) * count, "input");
+        buffer_wrap(rt, &indices, CL_MEM_READ_WRITE, index, sizeof(cl_uint) * count, "indices");
+        buffer_create(rt, &output, CL_MEM_READ_WRITE, sizeof(float) * count);
+
+        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input.mem);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output.mem);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_ulong), &count_arg);
+        err |= opencl_enqueue_range(rt->queue, kernel, count, 0, 0, NULL, &event);
+	ocl_error("Running square", err);
+        profile_event(&rt->profile, event, "square");
+        clReleaseEvent(event);
+
+        sort_run(rt, SORT_FLOAT, output.mem, indices.mem, count);
+
+        // Every result must be the square of the input it came from, in ascending order
+        results = buffer_map(rt, &output, CL_MAP_READ);
+        order = buffer_map(rt, &indices, CL_MAP_READ);
+        for(size_t i = 0; i < count; i++) {
+                if(order[i] < count && !seen[order[i]] && results[i] == data[order[i]] * data[order[i]] &&
+                   (i == 0 || results[i - 1] <= results[i])) {
+                        seen[order[i]] = 1;
+                        correct++;
+                } else {
+                        printf("[%lu]: %f from index %u out of order\n", (unsigned long)i, results[i], order[i]);
+                }
+        }
+        buffer_unmap(rt, &indices);
+        buffer_unmap(rt, &output);
+
+        buffer_release(rt, &input);
+        buffer_release(rt, &indices);
+        buffer_release(rt, &output);
+        free(index);
+        free(seen);
+        return correct;
+}
+
+/*
+ * Squares 'count' values by streaming them through the device in chunks, so
+ * 'count' is not limited by device memory. Chunks of a mapped input file are
+ * uploaded straight from the page cache.
+ */
+static size_t
+square_streaming(struct ocl_runtime *rt, cl_kernel kernel, const float *data, size_t count)
+{
+        float *results = host_alloc(sizeof(float) * count);
+        size_t correct;
+
+        stream_run(rt, kernel, data, results, count, sizeof(float), 0);
+
+        correct = validate(data, results, count);
+        free(results);
+        return correct;
+}
+
+/*
+ * Squares 'count' values as ASYNC_JOBS independent jobs that are all
+ * submitted before the host waits for any of them.
+ */
+static size_t
+square_async(struct ocl_runtime *rt, cl_kernel kernel, const float *data, size_t count)
+{
+        float *results = host_alloc(sizeof(float) * count);
+        struct ocl_job jobs[ASYNC_JOBS];
+        size_t part = (count + ASYNC_JOBS - 1) / ASYNC_JOBS;
+        size_t correct;
+
+        for(unsigned int j = 0; j < ASYNC_JOBS; j++) {
+                size_t offset = (j * part < count) ? j * part : count;
+                size_t n = (count - offset < part) ? count - offset : part;
+                if(n > 0)
+                        job_submit(rt, &jobs[j], kernel, data + offset, sizeof(float) * n,
+                                   results + offset, sizeof(float) * n, n);
+        }
+
+        // Only block when the results are actually consumed
+        for(unsigned int j = 0; j < ASYNC_JOBS; j++) {
+                if(j * part < count)
+                        job_wait(&jobs[j]);
+        }
+
+        correct = validate(data, results, count);
+        free(results);
+        return correct;
+}
+
+/*
+ * Squares 'count' values on the host when there is no OpenCL device.
+ */
+static size_t
+square_host(const float *data, size_t count)
+{
+        float *results = host_alloc(sizeof(float) * count);
+        size_t correct;
+
+        printf("Running on the host: %s, %u threads.\n", host_isa_name(host_isa()), host_threads());
+        host_run("square", data, results, count);
+
+        correct = validate(data, results, count);
+        free(results);
+        return correct;
+}
+
+/*
+ * Squares 'count' values with every available device working on a share
+ * proportional to its measured throughput.
+ */
+static size_t
+square_multidevice(const float *data, size_t count, unsigned int flags)
+{
+        struct ocl_multidev md;
+        float *results = host_alloc(sizeof(float) * count);
+        size_t shares[MULTIDEV_MAX_DEVICES];
+        size_t correct;
+
+        multidev_setup(&md, "square.cl", count, flags);
+        multidev_partition(&md, count, shares);
+        for(unsigned int i = 0; i < md.num_devices; i++)
+                printf("Device %d: %lu elements\n", i, (unsigned long)shares[i]);
+
+        multidev_run(&md, "square", data, results, count, sizeof(float));
+
+        for(unsigned int i = 0; i < md.num_devices; i++) {
+                if(md.runtimes[i]->profile.enabled) {
+                        printf("Device %d:\n", i);
+                        profile_print(&md.runtimes[i]->profile, stdout);
+                }
+        }
+        multidev_destroy(&md);
+
+        correct = validate(data, results, count);
+        free(results);
+        return correct;
+}
+
+int main(int argc, char **argv)
+{
+        struct ocl_runtime rt;              // device, context, queue and programs
+        cl_kernel kernel;                   // compute kernel
+        size_t correct;                     // number of correct results returned
+        int benchmark_select = 0;           // pick the device by measured throughput
+        int streaming = 0;                  // chunked, double-buffered execution
+        int multidevice = 0;                // split the job across all devices
+        int async = 0;                      // several jobs in flight
+        int fixed = 0;                      // kernel specialized for 'count'
+        int reduce = 0;                     // reduce the results on the device
+        int sorted = 0;                     // sort the results on the device
+        int filtered = 0;                   // only read back the results above 'threshold'
+        float threshold = 0.0f;
+        int generated = 0;                  // filter through a generated predicate
+        unsigned int bins = 0;              // histogram bins of the results, 0 for none
+        size_t count = 0;                   // number of elements, 0 for the default
+        const char *input_file = NULL;      // raw floats to square instead of random ones
+        struct mapped_file file;            // 'input_file' mapped into memory
+        const float *data;                  // data set to square
+        unsigned int width = 0;             // vector width, 0 picks one for the device
+        unsigned int flags = 0;             // setup_opencl() flags
+        const char *profile_json = NULL;    // where to dump profiling records
+        int (*check)(struct ocl_runtime *) = NULL;  // device check to run instead of squaring
+        const char *check_option = NULL;
+
+        for(int arg = 1; arg < argc; arg++) {
+                if(strcmp(argv[arg], "-b") == 0) {
+                        benchmark_select = 1;
+                } else if(strcmp(argv[arg], "-p") == 0) {
+                        flags |= OPENCL_PROFILING;
+                } else if(strcmp(argv[arg], "-n") == 0 && arg + 1 < argc) {
+                        count = strtoull(argv[++arg], NULL, 0);
+                } else if(strcmp(argv[arg], "-i") == 0 && arg + 1 < argc) {
+                        input_file = argv[++arg];
+                } else if(strcmp(argv[arg], "-s") == 0) {
+                        streaming = 1;
+                } else if(strcmp(argv[arg], "-m") == 0) {
+                        multidevice = 1;
+                } else if(strcmp(argv[arg], "-w") == 0 && arg + 1 < argc) {
+                        width = strtoul(argv[++arg], NULL, 0);
+                } else if(strcmp(argv[arg], "-o") == 0) {
+                        sorted = 1;
+                } else if(strcmp(argv[arg], "-r") == 0) {
+                        reduce = 1;
+                } else if(strcmp(argv[arg], "-g") == 0 && arg + 1 < argc) {
+                        bins = strtoul(argv[++arg], NULL, 0);
+                } else if(strcmp(argv[arg], "-t") == 0 && arg + 1 < argc) {
+                        filtered = 1;
+                        threshold = strtof(argv[++arg], NULL);
+                } else if(strcmp(argv[arg], "-q") == 0) {
+                        generated = 1;
+                } else if(strcmp(argv[arg], "-f") == 0) {
+                        fixed = 1;
+                } else if(strcmp(argv[arg], "-a") == 0) {
+                        async = 1;
+                } else if(strcmp(argv[arg], "-e") == 0) {
+                        check = check_stencils;
+                        check_option = argv[arg];
+                } else if(strcmp(argv[arg], "-l") == 0) {
+                        check = check_layouts;
+                        check_option = argv[arg];
+                } else if(strcmp(argv[arg], "-x") == 0) {
+                        check = check_scans;
+                        check_option = argv[arg];
+                } else if(strcmp(argv[arg], "-j") == 0 && arg + 1 < argc) {
+                        flags |= OPENCL_PROFILING;
+                        profile_json = argv[++arg];
+                } else {
+                        usage(argv[0]);
+                        return EXIT_FAILURE;
+                }
+        }
+
+        memset(&file, 0, sizeof(file));
+        if(input_file != NULL) {
+                data = input_data(input_file, &file, &count);
+        } else {
+                if(count == 0)
+                        count = DATA_SIZE;
+                data = random_data(count);
+        }
+
+        if(multidevice) {
+                correct = square_multidevice(data, count, flags);
+                printf("Computed '%lu/%lu' correct values!\n", (unsigned long)correct, (unsigned long)count);
+                release_data(data, &file);
+                return (correct == count) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        // Without a device that calibrates, setup_opencl() picks by static
+        // score or falls back to the host
+        unsigned int platform = 0, device = 0;
+        if(benchmark_select && get_fastest_device(count, &platform, &device))
+                setup_opencl_device(&rt, platform, device, flags);
+        else
+                setup_opencl(&rt, flags);
+        if(check != NULL) {
+                int ok;
+
+                if(rt.host_fallback) {
+                        printf("Error: %s needs an OpenCL device\n", check_option);
+                        exit(1);
+                }
+                ok = check(&rt);
+                destroy_opencl(&rt);
+                release_data(data, &file);
+                return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if(rt.host_fallback) {
+                correct = square_host(data, count);
+                printf("Computed '%lu/%lu' correct values!\n", (unsigned long)correct, (unsigned long)count);
+                release_data(data, &file);
+                return (correct == count) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        kernel = square_kernel(&rt, 1);
+        if(width == 0)
+                width = square_vector_width(&rt);
+
+        if(streaming)
+                correct = square_streaming(&rt, kernel, data, count);
+        else if(async)
+                correct = square_async(&rt, kernel, data, count);
+        else if(filtered)
+                correct = square_filtered(&rt, kernel, threshold, generated, data, count);
+        else if(sorted)
+                correct = square_sorted(&rt, kernel, data, count);
+        else
+                correct = square_resident(&rt, width, fixed, reduce, bins, data, count);
 
         // Print a brief summary detailing the results
-        printf("Computed '%d/%d' correct values!\n", correct, count);
+        printf("Computed '%lu/%lu' correct values!\n", (unsigned long)correct, (unsigned long)count);
+
+        if(rt.profile.enabled) {
+                profile_print(&rt.profile, stdout);
+                bufpool_print(&rt.pool, stdout);
+                if(profile_json != NULL) {
+                        FILE *f = fopen(profile_json, "w");
+                        if(f == NULL) {
+                                printf("Error: Unable to open %s for writing\n", profile_json);
+                                exit(1);
+                        }
+                        profile_dump_json(&rt.profile, f);
+                        fclose(f);
+                }
+        }
+
+        destroy_opencl(&rt);
+        release_data(data, &file);
+        return (correct == count) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scan.h"
+#include "util.h"
+
+static const char *scan_type_names[SCAN_TYPE_COUNT] = { "int", "uint", "float" };
+
+
+static cl_kernel
+scan_kernel(struct ocl_runtime *rt, const char *stage, enum scan_type type)
+{
+        char name[64];
+
+        snprintf(name, sizeof(name), "scan_%s_%s", stage, scan_type_names[type]);
+        return opencl_require_kernel(rt, "scan.cl", name);
+}
+
+/*
+ * Scans 'count' elements of 'input' into 'output' (which may be the same
+ * buffer). Every block of 2 * 'local' elements is scanned on its own, then
+ * the block totals are scanned recursively and added back. The grand total
+ * is read into 'total' once a single block is left, if 'total' is not NULL.
+ */
+static void
+scan_level(struct ocl_runtime *rt, enum scan_type type, int mode, cl_mem input, cl_mem output, size_t count,
+           size_t local, void *total)
+{
+        cl_int err;
+        cl_event event;
+        cl_kernel block = scan_kernel(rt, "block", type);
+        cl_kernel add = scan_kernel(rt, "add", type);
+        size_t elements = 2 * local;
+        size_t blocks = (count + elements - 1) / elements;
+        cl_mem sums;
+        cl_ulong count_arg = count;
+        cl_uint inclusive = (mode == SCAN_INCLUSIVE);
+
+        if(blocks == 0)
+                blocks = 1;
+        sums = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_uint) * blocks);
+
+        err  = clSetKernelArg(block, 0, sizeof(cl_mem), &input);
+        err |= clSetKernelArg(block, 1, sizeof(cl_mem), &output);
+        err |= clSetKernelArg(block, 2, sizeof(cl_mem), &sums);
+        err |= clSetKernelArg(block, 3, sizeof(cl_ulong), &count_arg);
+        err |= clSetKernelArg(block, 4, sizeof(cl_uint), &inclusive);
+        err |= clSetKernelArg(block, 5, sizeof(cl_uint) * elements, NULL);
+	ocl_error("Setting scan kernel arguments", err);
+        err = opencl_enqueue_range(rt->queue, block, blocks * local, local, 0, NULL, &event);
+	ocl_error("Enqueueing block scan", err);
+        profile_event(&rt->profile, event, "scan block");
+        clReleaseEvent(event);
+
+        if(blocks > 1) {
+                // Block totals become block offsets, then every block gets its offset added
+                scan_level(rt, type, SCAN_EXCLUSIVE, sums, sums, blocks, local, total);
+
+                err  = clSetKernelArg(add, 0, sizeof(cl_mem), &output);
+                err |= clSetKernelArg(add, 1, sizeof(cl_mem), &sums);
+                err |= clSetKernelArg(add, 2, sizeof(cl_ulong), &count_arg);
+		ocl_error("Setting scan kernel arguments", err);
+                err = opencl_enqueue_range(rt->queue, add, blocks * local, local, 0, NULL, &event);
+		ocl_error("Enqueueing scan add-back", err);
+                profile_event(&rt->profile, event, "scan add");
+                clReleaseEvent(event);
+        } else if(total != NULL) {
+                err = clEnqueueReadBuffer(rt->queue, sums, CL_TRUE, 0, sizeof(cl_uint), total, 0, NULL, NULL);
+		ocl_error("Reading scan total", err);
+        }
+
+        bufpool_release(&rt->pool, sums);
+}
+
+/*
+ * Prefix sum of the first 'count' int, uint or float elements of 'input'
+ * into 'output', SCAN_EXCLUSIVE or SCAN_INCLUSIVE. 'input' and 'output' may
+ * be the same buffer. If 'total' is not NULL, the sum of all elements (one
+ * element of 'type') is stored there, which is what compaction and sorting
+ * need next. Float sums are not associative, so results may differ from a
+ * serial scan in the last bits.
+ */
+void
+scan_run(struct ocl_runtime *rt, enum scan_type type, int mode, cl_mem input, cl_mem output, size_t count,
+         void *total)
+{
+        size_t local = opencl_local_size(rt, scan_kernel(rt, "block", type), SCAN_LOCAL);
+        size_t add_local = opencl_local_size(rt, scan_kernel(rt, "add", type), SCAN_LOCAL);
+
+        // Both kernels must agree on the block size
+        if(add_local < local)
+                local = add_local;
+        scan_level(rt, type, mode, input, output, count, local, total);
+}
@@ -0,0 +1,75 @@
+/*
+ * Work-efficient (Blelloch) prefix sums. scan_block_T scans blocks of two
+ * elements per work-item in __local memory and stores each block's total;
+ * the host scans those totals the same way and scan_add_T adds them back, so
+ * any length is handled. Work-groups are numbered from get_global_id(), which
+ * includes the global work offset, so split launches keep working. The local
+ * size must be a power of two.
+ */
+
+#define SCAN(T)                                                                                 \
+__kernel void scan_block_##T(__global const T* input, __global T* output, __global T* block_sums, \
+                             const ulong count, const uint inclusive, __local T* scratch)       \
+{                                                                                               \
+   size_t lid = get_local_id(0);                                                                \
+   size_t half = get_local_size(0);                                                             \
+   size_t n = 2 * half;                                                                         \
+   size_t group = get_global_id(0) / half;                                                      \
+   size_t a = group * n + lid;                                                                  \
+   size_t b = a + half;                                                                         \
+   T va = (a < count) ? input[a] : 0;                                                           \
+   T vb = (b < count) ? input[b] : 0;                                                           \
+   size_t offset = 1;                                                                           \
+                                                                                                \
+   scratch[lid] = va;                                                                           \
+   scratch[lid + half] = vb;                                                                    \
+                                                                                                \
+   /* Up-sweep: partial sums of growing subtrees, the total ends up last */                     \
+   for(size_t d = half; d > 0; d /= 2) {                                                        \
+       barrier(CLK_LOCAL_MEM_FENCE);                                                            \
+       if(lid < d)                                                                              \
+           scratch[offset * (2 * lid + 2) - 1] += scratch[offset * (2 * lid + 1) - 1];          \
+       offset *= 2;                                                                             \
+   }                                                                                            \
+   if(lid == 0) {                                                                               \
+       block_sums[group] = scratch[n - 1];                                                      \
+       scratch[n - 1] = 0;                                                                      \
+   }                                                                                            \
+                                                                                                \
+   /* Down-sweep: push the prefix of every subtree to its leaves */                             \
+   for(size_t d = 1; d < n; d *= 2) {                                                           \
+       offset /= 2;                                                                             \
+       barrier(CLK_LOCAL_MEM_FENCE);                                                            \
+       if(lid < d) {                                                                            \
+           size_t ai = offset * (2 * lid + 1) - 1;                                              \
+           size_t bi = offset * (2 * lid + 2) - 1;                                              \
+           T t = scratch[ai];                                                                   \
+           scratch[ai] = scratch[bi];                                                           \
+           scratch[bi] += t;                                                                    \
+       }                                                                                        \
+   }                                                                                            \
+   barrier(CLK_LOCAL_MEM_FENCE);                                                                \
+                                                                                                \
+   if(a < count)                                                                                \
+       output[a] = scratch[lid] + (inclusive ? va : 0);                                         \
+   if(b < count)                                                                                \
+       output[b] = scratch[lid + half] + (inclusive ? vb : 0);                                  \
+}                                                                                               \
+                                                                                                \
+__kernel void scan_add_##T(__global T* output, __global const T* block_offsets, const ulong count) \
+{                                                                                               \
+   size_t half = get_local_size(0);                                                             \
+   size_t group = get_global_id(0) / half;                                                      \
+   size_t a = group * 2 * half + get_local_id(0);                                               \
+   size_t b = a + half;                                                                         \
+   T offset = block_offsets[group];                                                             \
+                                                                                                \
+   if(a < count)                                                                                \
+       output[a] += offset;                                                                     \
+   if(b < count)                                                                                \
+       output[b] += offset;                                                                     \
+}
+
+SCAN(int)
+SCAN(uint)
+SCAN(float)
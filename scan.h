@@ -0,0 +1,26 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+#define SCAN_LOCAL (256)		// largest work-group size, each scans twice as many elements
+
+enum scan_type {
+        SCAN_INT,
+        SCAN_UINT,
+        SCAN_FLOAT,
+        SCAN_TYPE_COUNT
+};
+
+// scan_run() modes
+#define SCAN_EXCLUSIVE (0)		// output[i] = input[0] + ... + input[i - 1]
+#define SCAN_INCLUSIVE (1)		// output[i] = input[0] + ... + input[i]
+
+void scan_run(struct ocl_runtime *rt, enum scan_type type, int mode, cl_mem input, cl_mem output, size_t count,
+              void *total);
+
+#endif //SCAN_H
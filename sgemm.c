@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sgemm.h"
+#include "specialize.h"
+#include "util.h"
+
+
+/*
+ * Picks the largest tile whose two __local tiles fit in half of the device's
+ * local memory (leaving room for the compiler and other kernels) and whose
+ * TILE x SGEMM_RTS work-group the device can run. Every work-item then
+ * accumulates TILE / SGEMM_RTS rows of C in registers. The built kernel may
+ * still need a smaller tile, see sgemm_kernel().
+ */
+void
+sgemm_configure(struct ocl_runtime *rt, struct sgemm_config *config)
+{
+        cl_int err;
+        cl_ulong local_mem;
+        size_t max_group;
+        unsigned int tile = SGEMM_MAX_TILE;
+
+        err  = clGetDeviceInfo(rt->device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem), &local_mem, NULL);
+        err |= clGetDeviceInfo(rt->device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_group), &max_group, NULL);
+	ocl_error("Unable to get device info", err);
+
+        while(tile > SGEMM_MIN_TILE &&
+              (2 * sizeof(cl_float) * tile * tile > local_mem / 2 || (size_t)tile * SGEMM_RTS > max_group))
+                tile /= 2;
+
+        config->tile = tile;
+        config->wpt = tile / SGEMM_RTS;
+}
+
+/*
+ * Builds the kernel for 'config'. The work-group size is compiled in, so a
+ * build that can not run a whole tile (e.g. for lack of registers) is
+ * rebuilt with the tile halved, updating 'config'.
+ */
+static cl_kernel
+sgemm_kernel(struct ocl_runtime *rt, struct sgemm_config *config, int trans_a, int trans_b)
+{
+        struct specialization spec;
+        cl_kernel kernel;
+        size_t max_group;
+        cl_int err;
+
+        for(;;) {
+                specialize_init(&spec, SPECIALIZE_MAD);
+                specialize_define(&spec, "TILE", config->tile);
+                specialize_define(&spec, "WPT", config->wpt);
+                specialize_define(&spec, "TRANS_A", trans_a != 0);
+                specialize_define(&spec, "TRANS_B", trans_b != 0);
+                kernel = specialize_kernel(rt, "sgemm.cl", &spec, "sgemm");
+
+                err = clGetKernelWorkGroupInfo(kernel, rt->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_group),
+                                               &max_group, NULL);
+		ocl_error("Failed to retrieve kernel work group info", err);
+                if((size_t)config->tile * SGEMM_RTS <= max_group)
+                        return kernel;
+                if(config->tile <= SGEMM_MIN_TILE) {
+                        printf("Error: The sgemm kernel can not run a %u x %u work-group\n", config->tile,
+                               SGEMM_RTS);
+                        exit(1);
+                }
+                config->tile /= 2;
+                config->wpt = config->tile / SGEMM_RTS;
+        }
+}
+
+/*
+ * C = alpha * op(A) * op(B) + beta * C on row-major matrices, op(X) being X
+ * or its transpose, with op(A) M x K, op(B) K x N and C M x N. 'lda', 'ldb'
+ * and 'ldc' are the row pitches in floats of the matrices as stored. With
+ * beta 0 the previous contents of C are not read. Enqueued on the runtime's
+ * queue without waiting.
+ */
+void
+sgemm_run(struct ocl_runtime *rt, int trans_a, int trans_b, size_t m, size_t n, size_t k,
+          float alpha, cl_mem a, size_t lda, cl_mem b, size_t ldb, float beta, cl_mem c, size_t ldc)
+{
+        cl_int err;
+        cl_event event;
+        struct sgemm_config config;
+        cl_kernel kernel;
+        size_t global[2], local[2];
+        cl_uint args[6] = { m, n, k, lda, ldb, ldc };
+
+        if(m > 0xffffffffUL || n > 0xffffffffUL || k > 0xffffffffUL ||
+           lda > 0xffffffffUL || ldb > 0xffffffffUL || ldc > 0xffffffffUL) {
+                printf("Error: sgemm dimensions must be below 2^32\n");
+                exit(1);
+        }
+        if(m == 0 || n == 0)
+                return;
+
+        sgemm_configure(rt, &config);
+        kernel = sgemm_kernel(rt, &config, trans_a, trans_b);
+
+        err  = clSetKernelArg(kernel, 0, sizeof(cl_uint), &args[0]);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_uint), &args[1]);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_uint), &args[2]);
+        err |= clSetKernelArg(kernel, 3, sizeof(cl_float), &alpha);
+        err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &a);
+        err |= clSetKernelArg(kernel, 5, sizeof(cl_uint), &args[3]);
+        err |= clSetKernelArg(kernel, 6, sizeof(cl_mem), &b);
+        err |= clSetKernelArg(kernel, 7, sizeof(cl_uint), &args[4]);
+        err |= clSetKernelArg(kernel, 8, sizeof(cl_float), &beta);
+        err |= clSetKernelArg(kernel, 9, sizeof(cl_mem), &c);
+        err |= clSetKernelArg(kernel, 10, sizeof(cl_uint), &args[5]);
+	ocl_error("Setting sgemm kernel arguments", err);
+
+        local[0] = config.tile;
+        local[1] = config.tile / config.wpt;
+        global[0] = (n + config.tile - 1) / config.tile * local[0];
+        global[1] = (m + config.tile - 1) / config.tile * local[1];
+        err = clEnqueueNDRangeKernel(rt->queue, kernel, 2, NULL, global, local, 0, NULL, &event);
+	ocl_error("Enqueueing sgemm", err);
+        profile_event(&rt->profile, event, "sgemm");
+        clReleaseEvent(event);
+}
+
+/*
+ * Estimated single precision peak of the device in GFLOP/s: compute units x
+ * clock x lanes per compute unit x 2 (one multiply-add per lane and cycle).
+ * OpenCL does not report lanes per compute unit; the native float vector
+ * width is used on CPUs and the preferred work-group size multiple (the
+ * warp or wavefront) elsewhere. $OPENCL_PEAK_GFLOPS overrides the estimate.
+ */
+double
+sgemm_peak_gflops(struct ocl_runtime *rt)
+{
+        cl_int err;
+        cl_uint compute_units, clock_mhz, lanes;
+        cl_device_type type;
+        const char *env = getenv("OPENCL_PEAK_GFLOPS");
+        struct sgemm_config config;
+        size_t multiple;
+
+        if(env != NULL && atof(env) > 0.0)
+                return atof(env);
+
+        err  = clGetDeviceInfo(rt->device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+        err |= clGetDeviceInfo(rt->device, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(clock_mhz), &clock_mhz, NULL);
+        err |= clGetDeviceInfo(rt->device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+        err |= clGetDeviceInfo(rt->device, CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT, sizeof(lanes), &lanes, NULL);
+	ocl_error("Unable to get device info", err);
+
+        if(!(type & CL_DEVICE_TYPE_CPU)) {
+                sgemm_configure(rt, &config);
+                err = clGetKernelWorkGroupInfo(sgemm_kernel(rt, &config, 0, 0), rt->device,
+                                               CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(multiple),
+                                               &multiple, NULL);
+		ocl_error("Failed to retrieve kernel work group info", err);
+                lanes = multiple;
+        }
+        return compute_units * (double)clock_mhz * 1e-3 * (lanes > 0 ? lanes : 1) * 2.0;
+}
@@ -0,0 +1,87 @@
+/*
+ * C = alpha * op(A) * op(B) + beta * C for row-major matrices, op(A) being
+ * M x K and op(B) K x N. Built per configuration (see sgemm.c) with:
+ *
+ *   TILE     edge of the square tiles of A and B staged in __local memory
+ *   WPT      rows of C each work-item accumulates in registers
+ *   TRANS_A  A is stored K x M and used transposed (0 or 1)
+ *   TRANS_B  B is stored N x K and used transposed (0 or 1)
+ *
+ * Work-groups are TILE x (TILE / WPT) work-items computing one TILE x TILE
+ * tile of C; dimension 0 runs along the columns of C so that neighbouring
+ * work-items access neighbouring addresses. Edges of any size are handled by
+ * padding the tiles with zeros.
+ */
+
+#ifndef TILE
+#define TILE 16
+#endif
+#ifndef WPT
+#define WPT 4
+#endif
+#ifndef TRANS_A
+#define TRANS_A 0
+#endif
+#ifndef TRANS_B
+#define TRANS_B 0
+#endif
+
+#define RTS (TILE / WPT)	// work-items along the rows of a tile
+
+#if TRANS_A
+#define A_AT(m, k) a[(size_t)(k) * lda + (m)]
+#else
+#define A_AT(m, k) a[(size_t)(m) * lda + (k)]
+#endif
+#if TRANS_B
+#define B_AT(k, n) b[(size_t)(n) * ldb + (k)]
+#else
+#define B_AT(k, n) b[(size_t)(k) * ldb + (n)]
+#endif
+
+__kernel __attribute__((reqd_work_group_size(TILE, RTS, 1)))
+void sgemm(const uint M, const uint N, const uint K, const float alpha,
+           __global const float* a, const uint lda, __global const float* b, const uint ldb,
+           const float beta, __global float* c, const uint ldc)
+{
+   __local float a_tile[TILE][TILE];	// [row of C][k]
+   __local float b_tile[TILE][TILE];	// [k][column of C]
+   uint col = get_local_id(0);
+   uint row = get_local_id(1);
+   uint tile_row = get_group_id(1) * TILE;
+   uint tile_col = get_group_id(0) * TILE;
+   float acc[WPT];
+
+   for(uint w = 0; w < WPT; w++)
+       acc[w] = 0.0f;
+
+   for(uint t = 0; t < K; t += TILE) {
+       // Every work-item stages WPT elements of each tile
+       for(uint w = 0; w < WPT; w++) {
+           uint r = row + w * RTS;
+           uint m = tile_row + r, k = t + col;
+           a_tile[r][col] = (m < M && k < K) ? A_AT(m, k) : 0.0f;
+           k = t + r;
+           uint n = tile_col + col;
+           b_tile[r][col] = (k < K && n < N) ? B_AT(k, n) : 0.0f;
+       }
+       barrier(CLK_LOCAL_MEM_FENCE);
+
+#pragma unroll
+       for(uint k = 0; k < TILE; k++) {
+           float bk = b_tile[k][col];
+           for(uint w = 0; w < WPT; w++)
+               acc[w] = mad(a_tile[row + w * RTS][k], bk, acc[w]);
+       }
+       barrier(CLK_LOCAL_MEM_FENCE);
+   }
+
+   uint n = tile_col + col;
+   for(uint w = 0; w < WPT; w++) {
+       uint m = tile_row + row + w * RTS;
+       if(m < M && n < N) {
+           size_t i = (size_t)m * ldc + n;
+           c[i] = (beta == 0.0f) ? alpha * acc[w] : alpha * acc[w] + beta * c[i];
+       }
+   }
+}
@@ -0,0 +1,27 @@
+#ifndef SGEMM_H
+#define SGEMM_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+#define SGEMM_MAX_TILE (32)
+#define SGEMM_MIN_TILE (8)
+#define SGEMM_RTS (4)			// work-items along the rows of a tile
+
+/*
+ * Tile configuration of the sgemm kernel for one device.
+ */
+struct sgemm_config {
+        unsigned int tile;		// edge of the __local tiles
+        unsigned int wpt;		// rows of C per work-item
+};
+
+void sgemm_configure(struct ocl_runtime *rt, struct sgemm_config *config);
+void sgemm_run(struct ocl_runtime *rt, int trans_a, int trans_b, size_t m, size_t n, size_t k,
+               float alpha, cl_mem a, size_t lda, cl_mem b, size_t ldb, float beta, cl_mem c, size_t ldc);
+double sgemm_peak_gflops(struct ocl_runtime *rt);
+
+#endif //SGEMM_H
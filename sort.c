@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scan.h"
+#include "sort.h"
+#include "util.h"
+
+
+static void
+sort_enqueue(struct ocl_runtime *rt, cl_kernel kernel, size_t global, size_t local, const char *label)
+{
+        cl_event event;
+        cl_int err = opencl_enqueue_range(rt->queue, kernel, global, local, 0, NULL, &event);
+
+	ocl_error("Enqueueing sort kernel", err);
+        profile_event(&rt->profile, event, label);
+        clReleaseEvent(event);
+}
+
+/*
+ * Converts int and float keys to order-preserving uints and back.
+ */
+static void
+sort_code(struct ocl_runtime *rt, const char *name, enum sort_type type, cl_mem keys, size_t count)
+{
+        cl_int err;
+        cl_kernel kernel = opencl_require_kernel(rt, "sort.cl", name);
+        cl_ulong count_arg = count;
+        cl_uint type_arg = type;
+
+        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &keys);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_ulong), &count_arg);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_uint), &type_arg);
+	ocl_error("Setting sort kernel arguments", err);
+        sort_enqueue(rt, kernel, count, 0, "sort code");
+}
+
+/*
+ * Sorts the first 'count' 32-bit keys of 'keys' in place, in ascending order
+ * of 'type'. If 'values' is not NULL its 32-bit entries are moved along with
+ * their keys. The sort is stable, so equal keys keep their order. Every pass
+ * runs on the runtime's queue, the data never leaves the device. 'count' must
+ * be below 2^32.
+ */
+void
+sort_run(struct ocl_runtime *rt, enum sort_type type, cl_mem keys, cl_mem values, size_t count)
+{
+        cl_int err;
+        cl_kernel histogram = opencl_require_kernel(rt, "sort.cl", "sort_histogram");
+        cl_kernel scatter = opencl_require_kernel(rt, "sort.cl", (values != NULL) ? "sort_scatter_pairs" : "sort_scatter_keys");
+        size_t local = opencl_local_size(rt, scatter, SORT_LOCAL);
+        size_t groups;
+        cl_mem src_keys = keys, src_values = values;
+        cl_mem dst_keys, dst_values = NULL, counts;
+        cl_ulong count_arg = count, groups_arg;
+        cl_uint items = SORT_ITEMS;
+
+        if(count < 2)
+                return;
+        if(count > 0xffffffffUL) {
+                printf("Error: Unable to sort %lu keys, at most 2^32 - 1 are supported\n", (unsigned long)count);
+                exit(1);
+        }
+
+        if(opencl_local_size(rt, histogram, SORT_LOCAL) < local)
+                local = opencl_local_size(rt, histogram, SORT_LOCAL);
+        groups = (count + local * SORT_ITEMS - 1) / (local * SORT_ITEMS);
+        groups_arg = groups;
+
+        dst_keys = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_uint) * count);
+        if(values != NULL)
+                dst_values = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_uint) * count);
+        counts = bufpool_acquire(&rt->pool, CL_MEM_READ_WRITE, sizeof(cl_uint) * SORT_RADIX * groups);
+
+        if(type != SORT_UINT)
+                sort_code(rt, "sort_encode", type, keys, count);
+
+        // An even number of passes, so the result ends up back in 'keys'
+        for(cl_uint shift = 0; shift < 32; shift += SORT_BITS) {
+                cl_mem tmp;
+                cl_uint arg = 0;
+
+                err  = clSetKernelArg(histogram, 0, sizeof(cl_mem), &src_keys);
+                err |= clSetKernelArg(histogram, 1, sizeof(cl_mem), &counts);
+                err |= clSetKernelArg(histogram, 2, sizeof(cl_ulong), &count_arg);
+                err |= clSetKernelArg(histogram, 3, sizeof(cl_ulong), &groups_arg);
+                err |= clSetKernelArg(histogram, 4, sizeof(cl_uint), &shift);
+                err |= clSetKernelArg(histogram, 5, sizeof(cl_uint), &items);
+                err |= clSetKernelArg(histogram, 6, sizeof(cl_uint) * SORT_RADIX, NULL);
+		ocl_error("Setting sort kernel arguments", err);
+                sort_enqueue(rt, histogram, groups * local, local, "sort histogram");
+
+                // Digit-major counts become the output offset of every (digit, block)
+                scan_run(rt, SCAN_UINT, SCAN_EXCLUSIVE, counts, counts, SORT_RADIX * groups, NULL);
+
+                err  = clSetKernelArg(scatter, arg++, sizeof(cl_mem), &src_keys);
+                err |= clSetKernelArg(scatter, arg++, sizeof(cl_mem), &dst_keys);
+                if(values != NULL) {
+                        err |= clSetKernelArg(scatter, arg++, sizeof(cl_mem), &src_values);
+                        err |= clSetKernelArg(scatter, arg++, sizeof(cl_mem), &dst_values);
+                }
+                err |= clSetKernelArg(scatter, arg++, sizeof(cl_mem), &counts);
+                err |= clSetKernelArg(scatter, arg++, sizeof(cl_ulong), &count_arg);
+                err |= clSetKernelArg(scatter, arg++, sizeof(cl_ulong), &groups_arg);
+                err |= clSetKernelArg(scatter, arg++, sizeof(cl_uint), &shift);
+                err |= clSetKernelArg(scatter, arg++, sizeof(cl_uint), &items);
+                err |= clSetKernelArg(scatter, arg++, sizeof(cl_uint) * SORT_RADIX * local, NULL);
+                err |= clSetKernelArg(scatter, arg++, sizeof(cl_uint) * local, NULL);
+		ocl_error("Setting sort kernel arguments", err);
+                sort_enqueue(rt, scatter, groups * local, local, "sort scatter");
+
+                tmp = src_keys;
+                src_keys = dst_keys;
+                dst_keys = tmp;
+                tmp = src_values;
+                src_values = dst_values;
+                dst_values = tmp;
+        }
+
+        if(type != SORT_UINT)
+                sort_code(rt, "sort_decode", type, keys, count);
+
+        bufpool_release(&rt->pool, dst_keys);
+        if(values != NULL)
+                bufpool_release(&rt->pool, dst_values);
+        bufpool_release(&rt->pool, counts);
+}
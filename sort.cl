@@ -0,0 +1,155 @@
+/*
+ * LSD radix sort of 32-bit keys, SORT_BITS bits per pass. Every work-group
+ * owns a block of get_local_size(0) * 'items' keys, each work-item a
+ * contiguous run of 'items' of them. sort_histogram counts the digits of
+ * every block, the host scans those counts (digit-major, so each (digit,
+ * block) pair gets its output offset) and sort_scatter moves the keys. Runs
+ * are ranked in work-item order, which keeps every pass stable. Work-groups
+ * are numbered from get_global_id() so split launches keep working.
+ */
+
+#define SORT_BITS 4
+#define SORT_RADIX (1 << SORT_BITS)
+#define SORT_DIGIT(k, shift) (((k) >> (shift)) & (SORT_RADIX - 1))
+
+// Must match enum sort_type in sort.h
+#define SORT_INT 1
+#define SORT_FLOAT 2
+
+/*
+ * Maps int and float keys to uints that sort in the same order: the sign
+ * bit of ints is flipped, negative floats have every bit flipped and
+ * positive floats only the sign bit.
+ */
+__kernel void sort_encode(__global uint* keys, const ulong count, const uint type)
+{
+   size_t i = get_global_id(0);
+   if(i >= count)
+       return;
+   if(type == SORT_FLOAT)
+       keys[i] ^= (keys[i] >> 31) ? 0xffffffffu : 0x80000000u;
+   else if(type == SORT_INT)
+       keys[i] ^= 0x80000000u;
+}
+
+__kernel void sort_decode(__global uint* keys, const ulong count, const uint type)
+{
+   size_t i = get_global_id(0);
+   if(i >= count)
+       return;
+   if(type == SORT_FLOAT)
+       keys[i] ^= (keys[i] >> 31) ? 0x80000000u : 0xffffffffu;
+   else if(type == SORT_INT)
+       keys[i] ^= 0x80000000u;
+}
+
+__kernel void sort_histogram(__global const uint* keys, __global uint* counts, const ulong count,
+                             const ulong groups, const uint shift, const uint items, __local uint* hist)
+{
+   size_t lid = get_local_id(0);
+   size_t local_size = get_local_size(0);
+   size_t group = get_global_id(0) / local_size;
+   size_t start = get_global_id(0) * items;
+   uint digits[SORT_RADIX];
+
+   for(uint d = 0; d < SORT_RADIX; d++)
+       digits[d] = 0;
+   for(size_t d = lid; d < SORT_RADIX; d += local_size)
+       hist[d] = 0;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   for(uint j = 0; j < items; j++) {
+       if(start + j < count)
+           digits[SORT_DIGIT(keys[start + j], shift)]++;
+   }
+   for(uint d = 0; d < SORT_RADIX; d++) {
+       if(digits[d] > 0)
+           atomic_add(&hist[d], digits[d]);
+   }
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   for(size_t d = lid; d < SORT_RADIX; d += local_size)
+       counts[d * groups + group] = hist[d];
+}
+
+/*
+ * Exclusive scan of SORT_RADIX * get_local_size(0) counts in 'data': every
+ * work-item scans SORT_RADIX of them serially, the work-item totals are
+ * scanned in 'sums' and added back.
+ */
+void sort_local_scan(__local uint* data, __local uint* sums)
+{
+   size_t lid = get_local_id(0);
+   size_t local_size = get_local_size(0);
+   __local uint* own = data + lid * SORT_RADIX;
+   uint sum = 0;
+
+   for(uint k = 0; k < SORT_RADIX; k++) {
+       uint v = own[k];
+       own[k] = sum;
+       sum += v;
+   }
+   sums[lid] = sum;
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   for(size_t s = 1; s < local_size; s *= 2) {
+       uint v = (lid >= s) ? sums[lid - s] : 0;
+       barrier(CLK_LOCAL_MEM_FENCE);
+       sums[lid] += v;
+       barrier(CLK_LOCAL_MEM_FENCE);
+   }
+
+   uint prefix = (lid > 0) ? sums[lid - 1] : 0;
+   for(uint k = 0; k < SORT_RADIX; k++)
+       own[k] += prefix;
+}
+
+/*
+ * Moves every key of the block to offsets[digit * groups + group] plus the
+ * number of keys of that digit before it in the block. 'ranks' holds
+ * SORT_RADIX * get_local_size(0) counts, 'sums' get_local_size(0).
+ */
+#define SORT_SCATTER(NAME, VALUE_ARGS, MOVE_VALUE)                                              \
+__kernel void NAME(__global const uint* keys, __global uint* keys_out VALUE_ARGS,               \
+                   __global const uint* offsets, const ulong count, const ulong groups,         \
+                   const uint shift, const uint items, __local uint* ranks, __local uint* sums) \
+{                                                                                               \
+   size_t lid = get_local_id(0);                                                                \
+   size_t local_size = get_local_size(0);                                                       \
+   size_t group = get_global_id(0) / local_size;                                                \
+   size_t start = get_global_id(0) * items;                                                     \
+   uint digits[SORT_RADIX];                                                                     \
+                                                                                                \
+   for(uint d = 0; d < SORT_RADIX; d++)                                                         \
+       digits[d] = 0;                                                                           \
+   for(uint j = 0; j < items; j++) {                                                            \
+       if(start + j < count)                                                                    \
+           digits[SORT_DIGIT(keys[start + j], shift)]++;                                        \
+   }                                                                                            \
+   /* Digit-major, so the scan ranks by digit, then by work-item */                             \
+   for(uint d = 0; d < SORT_RADIX; d++)                                                         \
+       ranks[d * local_size + lid] = digits[d];                                                 \
+   barrier(CLK_LOCAL_MEM_FENCE);                                                                \
+   sort_local_scan(ranks, sums);                                                                \
+   barrier(CLK_LOCAL_MEM_FENCE);                                                                \
+                                                                                                \
+   /* Where this work-item's first key of every digit goes */                                   \
+   for(uint d = 0; d < SORT_RADIX; d++)                                                         \
+       digits[d] = offsets[d * groups + group] + ranks[d * local_size + lid] - ranks[d * local_size]; \
+                                                                                                \
+   for(uint j = 0; j < items; j++) {                                                            \
+       size_t i = start + j;                                                                    \
+       if(i < count) {                                                                          \
+           uint key = keys[i];                                                                  \
+           uint pos = digits[SORT_DIGIT(key, shift)]++;                                         \
+           keys_out[pos] = key;                                                                 \
+           MOVE_VALUE                                                                           \
+       }                                                                                        \
+   }                                                                                            \
+}
+
+#define SORT_NO_VALUES
+#define SORT_VALUES , __global const uint* values, __global uint* values_out
+
+SORT_SCATTER(sort_scatter_keys, SORT_NO_VALUES, )
+SORT_SCATTER(sort_scatter_pairs, SORT_VALUES, values_out[pos] = values[i];)
@@ -0,0 +1,24 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+#define SORT_BITS (4)			// key bits per pass, must match sort.cl
+#define SORT_RADIX (1 << SORT_BITS)
+#define SORT_LOCAL (128)		// largest work-group size
+#define SORT_ITEMS (8)			// keys per work-item and pass
+
+// Key types, must match SORT_INT and SORT_FLOAT in sort.cl
+enum sort_type {
+        SORT_UINT,
+        SORT_INT,
+        SORT_FLOAT
+};
+
+void sort_run(struct ocl_runtime *rt, enum sort_type type, cl_mem keys, cl_mem values, size_t count);
+
+#endif //SORT_H
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "source.h"
+
+/*
+ * Loads the OpenCL source 'filename'. Sources embedded at build time are
+ * used as is, without touching the filesystem. With $OPENCL_KERNEL_DIR set,
+ * 'filename' is read from that directory instead, which lets kernels be
+ * edited without rebuilding. Any other file is read relative to the working
+ * directory. Returns 0 if the source can not be found.
+ */
+int
+source_load(const char *filename, struct kernel_source *source)
+{
+        const char *dir = getenv("OPENCL_KERNEL_DIR");
+        char path[1024];
+        int len;
+
+        memset(source, 0, sizeof(*source));
+
+        if(dir == NULL || dir[0] == '\0') {
+                for(unsigned int i = 0; i < num_embedded_sources; i++) {
+                        if(strcmp(embedded_sources[i].filename, filename) == 0) {
+                                source->data = embedded_sources[i].data;
+                                source->size = embedded_sources[i].size;
+                                source->hash = embedded_sources[i].hash;
+                                return 1;
+                        }
+                }
+                len = snprintf(path, sizeof(path), "%s", filename);
+        } else {
+                len = snprintf(path, sizeof(path), "%s/%s", dir, filename);
+        }
+
+        if(len < 0 || (size_t)len >= sizeof(path) || !map_file(path, &source->file))
+                return 0;
+        source->data = source->file.data;
+        source->size = source->file.size;
+        source->hash = hash_bytes(source->data, source->size, HASH_SEED);
+        return 1;
+}
+
+void
+source_release(struct kernel_source *source)
+{
+        if(source->file.data != NULL)
+                unmap_file(&source->file);
+        memset(source, 0, sizeof(*source));
+}
@@ -0,0 +1,35 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util.h"
+
+/*
+ * An OpenCL source compiled into the binary, see embedcl.c.
+ */
+struct embedded_source {
+        const char *filename;
+        const char *data;
+        size_t size;
+        uint64_t hash;			// hash_bytes(data, size, HASH_SEED)
+};
+
+/*
+ * A loaded OpenCL source, embedded or read from disk.
+ */
+struct kernel_source {
+        const char *data;
+        size_t size;
+        uint64_t hash;
+        struct mapped_file file;	// backs 'data' when loaded from disk
+};
+
+extern const struct embedded_source embedded_sources[];
+extern const unsigned int num_embedded_sources;
+
+int source_load(const char *filename, struct kernel_source *source);
+void source_release(struct kernel_source *source);
+
+#endif //SOURCE_H
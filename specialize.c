@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "specialize.h"
+
+void
+specialize_init(struct specialization *spec, unsigned int flags)
+{
+        memset(spec, 0, sizeof(*spec));
+        spec->flags = flags;
+}
+
+/*
+ * Bakes 'name' into the program as the constant 'value' (-D name=value),
+ * replacing an earlier value of the same name. Defines are kept sorted, so
+ * the order they are added in does not create distinct variants.
+ */
+void
+specialize_define(struct specialization *spec, const char *name, long long value)
+{
+        unsigned int i = 0;
+
+        if(strlen(name) >= sizeof(spec->defines[0].name)) {
+                printf("Error: Define name %s is too long\n", name);
+                exit(1);
+        }
+
+        while(i < spec->num_defines && strcmp(spec->defines[i].name, name) < 0)
+                i++;
+        if(i < spec->num_defines && strcmp(spec->defines[i].name, name) == 0) {
+                spec->defines[i].value = value;
+                return;
+        }
+
+        if(spec->num_defines >= SPECIALIZE_MAX_DEFINES) {
+                printf("Error: Too many defines for one specialization\n");
+                exit(1);
+        }
+        memmove(&spec->defines[i + 1], &spec->defines[i], sizeof(spec->defines[0]) * (spec->num_defines - i));
+        snprintf(spec->defines[i].name, sizeof(spec->defines[i].name), "%s", name);
+        spec->defines[i].value = value;
+        spec->num_defines++;
+}
+
+/*
+ * Writes the clBuildProgram() options string for 'spec' into 'options'.
+ */
+void
+specialize_options(const struct specialization *spec, char *options, size_t len)
+{
+        size_t used = 0;
+        int n;
+
+        options[0] = '\0';
+        for(unsigned int i = 0; i < spec->num_defines; i++) {
+                n = snprintf(options + used, len - used, "%s-D %s=%lld", (used > 0) ? " " : "",
+                             spec->defines[i].name, spec->defines[i].value);
+                used += (n > 0) ? n : 0;
+                if(used >= len)
+                        break;
+        }
+        if(used < len && (spec->flags & SPECIALIZE_FAST_MATH)) {
+                n = snprintf(options + used, len - used, "%s-cl-fast-relaxed-math", (used > 0) ? " " : "");
+                used += (n > 0) ? n : 0;
+        }
+        if(used < len && (spec->flags & SPECIALIZE_MAD)) {
+                n = snprintf(options + used, len - used, "%s-cl-mad-enable", (used > 0) ? " " : "");
+                used += (n > 0) ? n : 0;
+        }
+
+        if(used >= len) {
+                printf("Error: Build options for %u defines do not fit %lu bytes\n", spec->num_defines,
+                       (unsigned long)len);
+                exit(1);
+        }
+}
+
+/*
+ * Returns 'cl_source_filename' built as the variant 'spec'. Each variant is
+ * built once per runtime (see opencl_program()) and its binary is cached on
+ * disk under its own options, so only the first run pays for the compile.
+ */
+cl_program
+specialize_program(struct ocl_runtime *rt, const char *cl_source_filename, const struct specialization *spec)
+{
+        char options[MAX_NAME_LEN];
+
+        specialize_options(spec, options, sizeof(options));
+        return opencl_program(rt, cl_source_filename, options);
+}
+
+/*
+ * Returns the kernel 'name' of the variant 'spec' of 'cl_source_filename'.
+ */
+cl_kernel
+specialize_kernel(struct ocl_runtime *rt, const char *cl_source_filename, const struct specialization *spec,
+                  const char *name)
+{
+        cl_program program = specialize_program(rt, cl_source_filename, spec);
+        cl_kernel kernel = opencl_program_kernel(rt, program, name);
+
+        if(kernel == NULL) {
+                printf("Error: Kernel %s is not in %s\n", name, cl_source_filename);
+                exit(1);
+        }
+        return kernel;
+}
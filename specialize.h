@@ -0,0 +1,36 @@
+#ifndef SPECIALIZE_H
+#define SPECIALIZE_H
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+#define SPECIALIZE_MAX_DEFINES (8)
+
+// specialize_init() flags
+#define SPECIALIZE_FAST_MATH (1 << 0)	// -cl-fast-relaxed-math
+#define SPECIALIZE_MAD (1 << 1)		// -cl-mad-enable
+
+struct specialize_define {
+        char name[32];
+        long long value;
+};
+
+/*
+ * A set of build-time constants and compiler flags for one program variant.
+ */
+struct specialization {
+        unsigned int flags;
+        unsigned int num_defines;
+        struct specialize_define defines[SPECIALIZE_MAX_DEFINES];	// sorted by name
+};
+
+void specialize_init(struct specialization *spec, unsigned int flags);
+void specialize_define(struct specialization *spec, const char *name, long long value);
+void specialize_options(const struct specialization *spec, char *options, size_t len);
+cl_program specialize_program(struct ocl_runtime *rt, const char *cl_source_filename,
+                              const struct specialization *spec);
+cl_kernel specialize_kernel(struct ocl_runtime *rt, const char *cl_source_filename,
+                            const struct specialization *spec, const char *name);
+
+#endif //SPECIALIZE_H
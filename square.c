@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "specialize.h"
+#include "square.h"
+#include "util.h"
+
+
+/*
+ * Vector width for the square kernels on this device: the wider of the
+ * device's preferred and native float vector widths, rounded down to a
+ * width that has a kernel variant. $OPENCL_VECTOR_WIDTH overrides it.
+ */
+unsigned int
+square_vector_width(struct ocl_runtime *rt)
+{
+        cl_int err;
+        cl_uint preferred;
+        cl_uint native;
+        unsigned int width = 1;
+        const char *env = getenv("OPENCL_VECTOR_WIDTH");
+
+        if(env != NULL && atoi(env) > 0) {
+                preferred = native = atoi(env);
+        } else {
+                err  = clGetDeviceInfo(rt->device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(preferred),
+                                       &preferred, NULL);
+                err |= clGetDeviceInfo(rt->device, CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT, sizeof(native),
+                                       &native, NULL);
+		ocl_error("Unable to get device info", err);
+        }
+
+        while(width * 2 <= SQUARE_MAX_WIDTH && (width * 2 <= preferred || width * 2 <= native))
+                width *= 2;
+        return width;
+}
+
+/*
+ * Returns the square kernel processing 'width' floats per work-item, loading
+ * square.cl if needed. Width 1 is the scalar kernel.
+ */
+cl_kernel
+square_kernel(struct ocl_runtime *rt, unsigned int width)
+{
+        char name[32];
+
+        if(width > 1)
+                snprintf(name, sizeof(name), "square%u", width);
+        else
+                snprintf(name, sizeof(name), "square");
+
+        // Specialized builds of square.cl register the same names, only this build will do
+        return opencl_require_kernel(rt, "square.cl", name);
+}
+
+/*
+ * Number of work-items covering 'count' elements at 'width' per work-item.
+ */
+size_t
+square_work_items(size_t count, unsigned int width)
+{
+        return (count + width - 1) / width;
+}
+
+/*
+ * Returns square_fixed built for exactly 'count' floats, 'width' per vector
+ * and SQUARE_UNROLL vectors per work-item, with fast relaxed math. Each count
+ * is a separate build, so this is meant for jobs that repeat one size.
+ */
+cl_kernel
+square_fixed_kernel(struct ocl_runtime *rt, unsigned int width, size_t count)
+{
+        struct specialization spec;
+
+        specialize_init(&spec, SPECIALIZE_FAST_MATH | SPECIALIZE_MAD);
+        specialize_define(&spec, "FIXED_COUNT", count);
+        specialize_define(&spec, "UNROLL", SQUARE_UNROLL);
+        specialize_define(&spec, "WIDTH", width);
+        return specialize_kernel(rt, "square.cl", &spec, "square_fixed");
+}
+
+/*
+ * Number of work-items square_fixed needs, matching SQUARE_ITEMS in square.cl.
+ */
+size_t
+square_fixed_work_items(size_t count, unsigned int width)
+{
+        size_t vectors = count / width;
+        return (vectors >= SQUARE_UNROLL) ? (vectors + SQUARE_UNROLL - 1) / SQUARE_UNROLL : 1;
+}
@@ -1,7 +1,96 @@
-__kernel void square( __global float* input, __global float* output, const unsigned int count)
+/*
+ * Element counts are 64-bit (ulong) and indices size_t, so a kernel can cover
+ * more than 2^31 elements. Large ranges arrive as several launches with a
+ * global work offset (see opencl_enqueue_range()), which get_global_id()
+ * already includes.
+ */
+__kernel void square( __global float* input, __global float* output, const ulong count)
 {
-   int i = get_global_id(0);
+   size_t i = get_global_id(0);
    if(i < count)
        output[i] = input[i] * input[i];
 
 }
+
+/*
+ * squareN: each work-item squares N consecutive floats with one vector load
+ * and store. Launch with ceil(count / N) work-items; the work-item holding the
+ * tail falls back to scalar accesses so any count is handled.
+ */
+#define SQUARE_VECTOR(N)                                                                        \
+__kernel void square##N( __global float* input, __global float* output, const ulong count)      \
+{                                                                                               \
+   size_t i = get_global_id(0);                                                                 \
+   size_t base = i * N;                                                                         \
+   if(base + N <= count) {                                                                      \
+       float##N v = vload##N(i, input);                                                         \
+       vstore##N(v * v, i, output);                                                             \
+   } else {                                                                                     \
+       for(size_t j = base; j < count; j++)                                                     \
+           output[j] = input[j] * input[j];                                                     \
+   }                                                                                            \
+}
+
+SQUARE_VECTOR(2)
+SQUARE_VECTOR(4)
+SQUARE_VECTOR(8)
+SQUARE_VECTOR(16)
+
+#ifdef FIXED_COUNT
+/*
+ * square_fixed: built per job with -D FIXED_COUNT=n, optionally WIDTH (floats
+ * per vector, 1 to 16) and UNROLL (vectors per work-item). With the count
+ * known at compile time every bounds check below is a constant, so it is
+ * removed whenever the count divides evenly, and the inner loop is fully
+ * unrolled. Work-item i handles vectors i, i + SQUARE_ITEMS, ... which keeps
+ * neighbouring work-items on neighbouring memory. Launch SQUARE_ITEMS
+ * work-items; 'count' is ignored and only keeps the square signature.
+ */
+#ifndef WIDTH
+#define WIDTH 1
+#endif
+#ifndef UNROLL
+#define UNROLL 1
+#endif
+
+#define SQUARE_VECTORS (FIXED_COUNT / WIDTH)
+#define SQUARE_ITEMS (SQUARE_VECTORS >= UNROLL ? (SQUARE_VECTORS + UNROLL - 1) / UNROLL : 1)
+
+#if WIDTH == 1
+#define SQUARE_LOAD(i, p) ((p)[i])
+#define SQUARE_STORE(v, i, p) ((p)[i] = (v))
+typedef float square_vec;
+#else
+#define SQUARE_CAT(a, b) a##b
+#define SQUARE_XCAT(a, b) SQUARE_CAT(a, b)
+#define SQUARE_LOAD(i, p) SQUARE_XCAT(vload, WIDTH)(i, p)
+#define SQUARE_STORE(v, i, p) SQUARE_XCAT(vstore, WIDTH)(v, i, p)
+typedef SQUARE_XCAT(float, WIDTH) square_vec;
+#endif
+
+__kernel void square_fixed( __global float* input, __global float* output, const ulong count)
+{
+   size_t i = get_global_id(0);
+   if(i >= SQUARE_ITEMS)
+       return;
+
+#pragma unroll
+   for(unsigned int k = 0; k < UNROLL; k++) {
+       size_t v = i + k * SQUARE_ITEMS;
+#if SQUARE_VECTORS % UNROLL != 0 || SQUARE_VECTORS == 0
+       if(v < SQUARE_VECTORS)
+#endif
+       {
+           square_vec x = SQUARE_LOAD(v, input);
+           SQUARE_STORE(x * x, v, output);
+       }
+   }
+
+#if FIXED_COUNT % WIDTH != 0
+   if(i == 0) {
+       for(size_t j = SQUARE_VECTORS * WIDTH; j < FIXED_COUNT; j++)
+           output[j] = input[j] * input[j];
+   }
+#endif
+}
+#endif
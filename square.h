@@ -0,0 +1,19 @@
+#ifndef SQUARE_H
+#define SQUARE_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+#define SQUARE_MAX_WIDTH (16)
+#define SQUARE_UNROLL (4)	// vectors per work-item of square_fixed
+
+unsigned int square_vector_width(struct ocl_runtime *rt);
+cl_kernel square_kernel(struct ocl_runtime *rt, unsigned int width);
+size_t square_work_items(size_t count, unsigned int width);
+cl_kernel square_fixed_kernel(struct ocl_runtime *rt, unsigned int width, size_t count);
+size_t square_fixed_work_items(size_t count, unsigned int width);
+
+#endif //SQUARE_H
@@ -0,0 +1,320 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "stencil.h"
+#include "util.h"
+
+struct stencil_source {
+        char *data;
+        size_t len;
+        size_t capacity;
+};
+
+
+static void
+stencil_append(struct stencil_source *src, const char *format, ...)
+{
+        va_list args;
+        int n;
+
+        for(;;) {
+                va_start(args, format);
+                n = vsnprintf(src->data + src->len, src->capacity - src->len, format, args);
+                va_end(args);
+                if(n < 0) {
+                        printf("Error: Unable to generate stencil source\n");
+                        exit(1);
+                }
+                if(src->len + n < src->capacity)
+                        break;
+
+                src->capacity = (src->len + n + 1) * 2;
+                src->data = realloc(src->data, src->capacity);
+                if(src->data == NULL) {
+                        printf("Error: Out of memory generating stencil source\n");
+                        exit(1);
+                }
+        }
+        src->len += n;
+}
+
+/*
+ * Writes 'value' as an OpenCL C float literal. Whole numbers keep their
+ * decimal point and exponent ("1.000000000e+00f", never "1f"), infinities
+ * and NaN use the built-in constants. The bits are tested directly, as
+ * -ffast-math lets isnan() and isinf() be folded away.
+ */
+static void
+stencil_literal(char *literal, size_t len, float value)
+{
+        uint32_t bits;
+
+        memcpy(&bits, &value, sizeof(bits));
+        if((bits & 0x7f800000U) != 0x7f800000U)
+                snprintf(literal, len, "%.9ef", value);
+        else if(bits & 0x007fffffU)
+                snprintf(literal, len, "NAN");
+        else
+                snprintf(literal, len, "%sINFINITY", (bits & 0x80000000U) ? "-" : "");
+}
+
+/*
+ * Work-group tile that fits the device: starting from STENCIL_LOCAL points,
+ * the longest edge is halved until the tile has at most 'max_points' points
+ * and, with its halo of radius * steps points on every side, fits twice in
+ * local memory. Unused dimensions are 1.
+ */
+static void
+stencil_tile(struct ocl_runtime *rt, unsigned int dims, unsigned int radius, unsigned int steps,
+             size_t max_points, size_t *tile)
+{
+        static const size_t initial[STENCIL_MAX_DIMS][STENCIL_MAX_DIMS] = {
+                { STENCIL_LOCAL, 1, 1 }, { 16, 16, 1 }, { 8, 8, 4 }
+        };
+        cl_int err;
+        cl_ulong local_mem;
+        size_t max_group;
+        size_t max_items[MAX_RESOURCES];	// devices may have more than three dimensions
+        size_t halo = (size_t)radius * steps;
+
+        err  = clGetDeviceInfo(rt->device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem), &local_mem, NULL);
+        err |= clGetDeviceInfo(rt->device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_group), &max_group, NULL);
+        err |= clGetDeviceInfo(rt->device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(max_items), max_items, NULL);
+	ocl_error("Unable to get device info", err);
+
+        memcpy(tile, initial[dims - 1], sizeof(initial[0]));
+        for(;;) {
+                size_t points = 1, cells = 1;
+                unsigned int longest = 0;
+                int fits = 1;
+
+                for(unsigned int d = 0; d < dims; d++) {
+                        points *= tile[d];
+                        cells *= tile[d] + 2 * halo;
+                        if(tile[d] > max_items[d])
+                                fits = 0;
+                        if(tile[d] > tile[longest])
+                                longest = d;
+                }
+                if(fits && points <= max_group && points <= max_points && 2 * sizeof(cl_float) * cells <= local_mem)
+                        return;
+                if(tile[longest] == 1) {
+                        printf("Error: A stencil of radius %u over %u steps does not fit in local memory\n",
+                               radius, steps);
+                        exit(1);
+                }
+                tile[longest] /= 2;
+        }
+}
+
+/*
+ * OpenCL C for the stencil: every work-group loads its tile plus a halo of
+ * radius * steps points into __local memory (points outside the grid hold
+ * 'boundary'), applies up to 'steps' timesteps there, each leaving a valid
+ * region 'radius' points narrower, and writes back the tile. Unused
+ * dimensions have a size of 1 and no halo. Coefficients of 0 are left out.
+ */
+static void
+stencil_generate(struct stencil_source *src, unsigned int dims, unsigned int radius, const float *coefficients,
+                 unsigned int steps, float boundary, const size_t *tile)
+{
+        static const char axis[STENCIL_MAX_DIMS] = { 'X', 'Y', 'Z' };
+        unsigned int r[STENCIL_MAX_DIMS];
+        size_t extent[STENCIL_MAX_DIMS];
+        unsigned int terms = 0;
+        size_t c = 0;
+        char literal[32];
+
+        for(unsigned int d = 0; d < STENCIL_MAX_DIMS; d++) {
+                r[d] = (d < dims) ? radius : 0;
+                extent[d] = (d < dims) ? tile[d] + 2 * (size_t)r[d] * steps : 1;
+        }
+
+        stencil_append(src, "/* Generated by stencil.c */\n\n");
+        for(unsigned int d = 0; d < STENCIL_MAX_DIMS; d++) {
+                stencil_append(src, "#define B%c %lu\n", axis[d], (unsigned long)((d < dims) ? tile[d] : 1));
+                stencil_append(src, "#define R%c %u\n", axis[d], r[d]);
+                stencil_append(src, "#define H%c %lu\n", axis[d], (unsigned long)r[d] * steps);
+                stencil_append(src, "#define E%c %lu\n", axis[d], (unsigned long)extent[d]);
+        }
+        stencil_literal(literal, sizeof(literal), boundary);
+        stencil_append(src,
+                "#define CELLS (EX * EY * EZ)\n"
+                "#define BOUNDARY %s\n"
+                "#define INSIDE(x, y, z) ((x) >= 0 && (x) < (int)nx && (y) >= 0 && (y) < (int)ny && "
+                "(z) >= 0 && (z) < (int)nz)\n"
+                "#define AT(x, y, z) (((size_t)(z) * ny + (y)) * nx + (x))\n"
+                "\n"
+                "__kernel __attribute__((reqd_work_group_size(BX, BY, BZ)))\n"
+                "void stencil(__global const float* input, __global float* output, const uint nx, const uint ny,\n"
+                "             const uint nz, const uint steps)\n"
+                "{\n"
+                "   __local float cells[2][CELLS];\n"
+                "   size_t lid = get_local_id(0) + BX * (get_local_id(1) + BY * get_local_id(2));\n"
+                "   int ox = (int)(get_group_id(0) * BX) - HX;\n"
+                "   int oy = (int)(get_group_id(1) * BY) - HY;\n"
+                "   int oz = (int)(get_group_id(2) * BZ) - HZ;\n"
+                "   uint src = 0;\n"
+                "\n"
+                "   for(size_t i = lid; i < CELLS; i += BX * BY * BZ) {\n"
+                "       int x = i %% EX, y = (i / EX) %% EY, z = i / (EX * EY);\n"
+                "       cells[0][i] = INSIDE(ox + x, oy + y, oz + z) ? input[AT(ox + x, oy + y, oz + z)] : BOUNDARY;\n"
+                "   }\n"
+                "   barrier(CLK_LOCAL_MEM_FENCE);\n"
+                "\n"
+                "   for(uint s = 1; s <= steps; s++) {\n"
+                "       for(size_t i = lid; i < CELLS; i += BX * BY * BZ) {\n"
+                "           int x = i %% EX, y = (i / EX) %% EY, z = i / (EX * EY);\n"
+                "           if(x >= RX * s && x < EX - RX * s && y >= RY * s && y < EY - RY * s &&\n"
+                "              z >= RZ * s && z < EZ - RZ * s && INSIDE(ox + x, oy + y, oz + z))\n"
+                "               cells[1 - src][i] =", literal);
+
+        for(int dz = -(int)r[2]; dz <= (int)r[2]; dz++) {
+                for(int dy = -(int)r[1]; dy <= (int)r[1]; dy++) {
+                        for(int dx = -(int)r[0]; dx <= (int)r[0]; dx++, c++) {
+                                long offset = ((long)dz * extent[1] + dy) * (long)extent[0] + dx;
+                                if(coefficients[c] == 0.0f)
+                                        continue;
+                                stencil_literal(literal, sizeof(literal), coefficients[c]);
+                                stencil_append(src, "%s\n                   %s * cells[src][i + (%ld)]",
+                                               (terms > 0) ? " +" : "", literal, offset);
+                                terms++;
+                        }
+                }
+        }
+        if(terms == 0)
+                stencil_append(src, " 0.0f");
+
+        stencil_append(src,
+                ";\n"
+                "           else\n"
+                "               cells[1 - src][i] = cells[src][i];\n"
+                "       }\n"
+                "       barrier(CLK_LOCAL_MEM_FENCE);\n"
+                "       src = 1 - src;\n"
+                "   }\n"
+                "\n"
+                "   for(size_t i = lid; i < CELLS; i += BX * BY * BZ) {\n"
+                "       int x = i %% EX, y = (i / EX) %% EY, z = i / (EX * EY);\n"
+                "       if(x >= HX && x < HX + BX && y >= HY && y < HY + BY && z >= HZ && z < HZ + BZ &&\n"
+                "          INSIDE(ox + x, oy + y, oz + z))\n"
+                "           output[AT(ox + x, oy + y, oz + z)] = cells[src][i];\n"
+                "   }\n"
+                "}\n");
+}
+
+/*
+ * Generates and builds a 'dims'-dimensional stencil of 'radius' (at most
+ * STENCIL_MAX_RADIUS). 'coefficients' holds the weight of every point of
+ * the (2 * radius + 1)^dims neighbourhood, x varying fastest, the centre in
+ * the middle. Points outside the grid read as 'boundary'. Up to 'steps'
+ * timesteps run per launch from one load of the tile, at the cost of a halo
+ * of radius * steps points. The generated source is built once per runtime
+ * and cached on disk like any other program.
+ */
+void
+stencil_create(struct ocl_runtime *rt, struct stencil *st, unsigned int dims, unsigned int radius,
+               const float *coefficients, unsigned int steps, float boundary)
+{
+        struct stencil_source src;
+        char name[64];
+        cl_program program;
+        size_t max_points = STENCIL_LOCAL;
+        size_t max_group, points;
+        cl_int err;
+
+        if(dims < 1 || dims > STENCIL_MAX_DIMS || radius > STENCIL_MAX_RADIUS || steps < 1) {
+                printf("Error: Unsupported stencil of %u dimensions, radius %u and %u steps\n", dims, radius, steps);
+                exit(1);
+        }
+
+        memset(st, 0, sizeof(*st));
+        st->dims = dims;
+        st->radius = radius;
+        st->steps = steps;
+
+        // The tile is compiled in; a build that can not run it (e.g. for lack
+        // of registers) is generated again with half the points
+        for(;;) {
+                stencil_tile(rt, dims, radius, steps, max_points, st->tile);
+
+                memset(&src, 0, sizeof(src));
+                stencil_generate(&src, dims, radius, coefficients, steps, boundary, st->tile);
+
+                // Equal sources share one program
+                snprintf(name, sizeof(name), "stencil-%016llx.cl",
+                         (unsigned long long)hash_bytes(src.data, src.len, HASH_SEED));
+                program = opencl_program_source(rt, name, src.data, src.len, NULL);
+                free(src.data);
+
+                st->kernel = opencl_program_kernel(rt, program, "stencil");
+                if(st->kernel == NULL) {
+                        printf("Error: Kernel stencil is not in %s\n", name);
+                        exit(1);
+                }
+
+                err = clGetKernelWorkGroupInfo(st->kernel, rt->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_group),
+                                               &max_group, NULL);
+		ocl_error("Failed to retrieve kernel work group info", err);
+                points = st->tile[0] * st->tile[1] * st->tile[2];
+                if(points <= max_group)
+                        return;
+                if(points == 1) {
+                        printf("Error: The stencil kernel can not run a work-group\n");
+                        exit(1);
+                }
+                max_points = points / 2;
+        }
+}
+
+/*
+ * Advances the grid of 'size' points (one entry per dimension, x first) in
+ * 'grid' by 'timesteps' steps, in launches of up to st->steps steps that
+ * alternate between 'grid' and 'scratch' (of the same size). Returns the
+ * buffer holding the result.
+ */
+cl_mem
+stencil_run(struct ocl_runtime *rt, const struct stencil *st, const size_t *size, cl_mem grid, cl_mem scratch,
+            unsigned int timesteps)
+{
+        cl_int err;
+        cl_event event;
+        cl_uint n[STENCIL_MAX_DIMS];
+        size_t global[STENCIL_MAX_DIMS];
+        cl_mem in = grid, out = scratch, swap;
+
+        for(unsigned int d = 0; d < STENCIL_MAX_DIMS; d++) {
+                size_t points = (d < st->dims) ? size[d] : 1;
+                if(points == 0 || points > 0x7fffffffUL) {
+                        printf("Error: Unable to run a stencil over %lu points\n", (unsigned long)points);
+                        exit(1);
+                }
+                n[d] = points;
+                global[d] = (points + st->tile[d] - 1) / st->tile[d] * st->tile[d];
+        }
+
+        for(unsigned int done = 0; done < timesteps; done += st->steps) {
+                cl_uint steps = (timesteps - done < st->steps) ? timesteps - done : st->steps;
+
+                err  = clSetKernelArg(st->kernel, 0, sizeof(cl_mem), &in);
+                err |= clSetKernelArg(st->kernel, 1, sizeof(cl_mem), &out);
+                err |= clSetKernelArg(st->kernel, 2, sizeof(cl_uint), &n[0]);
+                err |= clSetKernelArg(st->kernel, 3, sizeof(cl_uint), &n[1]);
+                err |= clSetKernelArg(st->kernel, 4, sizeof(cl_uint), &n[2]);
+                err |= clSetKernelArg(st->kernel, 5, sizeof(cl_uint), &steps);
+		ocl_error("Setting stencil kernel arguments", err);
+                err = clEnqueueNDRangeKernel(rt->queue, st->kernel, st->dims, NULL, global, st->tile, 0, NULL, &event);
+		ocl_error("Enqueueing stencil", err);
+                profile_event(&rt->profile, event, "stencil");
+                clReleaseEvent(event);
+
+                swap = in;
+                in = out;
+                out = swap;
+        }
+        return in;
+}
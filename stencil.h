@@ -0,0 +1,31 @@
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+#define STENCIL_MAX_DIMS (3)
+#define STENCIL_MAX_RADIUS (4)
+#define STENCIL_LOCAL (256)		// largest work-group size
+
+/*
+ * A stencil kernel generated for one set of coefficients, see
+ * stencil_create(). The program belongs to the runtime it was built for.
+ */
+struct stencil {
+        unsigned int dims;			// 1, 2 or 3
+        unsigned int radius;			// points on each side of the centre
+        unsigned int steps;			// most timesteps fused into one launch
+        size_t tile[STENCIL_MAX_DIMS];		// output points per work-group, x first
+        cl_kernel kernel;
+};
+
+void stencil_create(struct ocl_runtime *rt, struct stencil *st, unsigned int dims, unsigned int radius,
+                    const float *coefficients, unsigned int steps, float boundary);
+cl_mem stencil_run(struct ocl_runtime *rt, const struct stencil *st, const size_t *size, cl_mem grid,
+                   cl_mem scratch, unsigned int timesteps);
+
+#endif //STENCIL_H
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream.h"
+#include "util.h"
+
+#define STREAM_MAX_CHUNK (64 * 1024 * 1024)	// bytes, keeps several chunks in flight
+
+
+/*
+ * Largest chunk in bytes for 'elem_size' elements such that STREAM_BUFFERS
+ * input/output pairs fit in device memory and each fits one allocation.
+ */
+size_t
+stream_chunk_size(struct ocl_runtime *rt, size_t elem_size)
+{
+        cl_int err;
+        cl_ulong max_alloc;
+        cl_ulong global_mem;
+        cl_ulong chunk;
+
+        err  = clGetDeviceInfo(rt->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL);
+        err |= clGetDeviceInfo(rt->device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(global_mem), &global_mem, NULL);
+	ocl_error("Unable to get device info", err);
+
+        chunk = global_mem / (2 * STREAM_BUFFERS);
+        if(chunk > max_alloc)
+                chunk = max_alloc;
+        if(chunk > STREAM_MAX_CHUNK)
+                chunk = STREAM_MAX_CHUNK;
+        chunk -= chunk % elem_size;
+        return (chunk > 0) ? chunk : elem_size;
+}
+
+static void
+stream_replace_event(cl_event *slot, cl_event event)
+{
+        if(*slot != NULL)
+                clReleaseEvent(*slot);
+        *slot = event;
+}
+
+/*
+ * Runs 'kernel(input, output, count)' over 'count' elements of 'elem_size'
+ * bytes that need not fit on the device. The data is split into chunks of at
+ * most 'chunk' elements (0 picks a size from the device limits) that rotate
+ * through STREAM_BUFFERS buffer sets, so that the upload of one chunk, the
+ * kernel on another and the download of a third run at the same time. Each
+ * step only waits on the events it actually depends on.
+ */
+void
+stream_run(struct ocl_runtime *rt, cl_kernel kernel, const void *input, void *output,
+           size_t count, size_t elem_size, size_t chunk)
+{
+        cl_int err;
+        cl_mem in[STREAM_BUFFERS], out[STREAM_BUFFERS];
+        cl_event written[STREAM_BUFFERS], computed[STREAM_BUFFERS], read[STREAM_BUFFERS];
+        size_t num_sets;
+
+        if(count == 0)
+                return;
+        if(chunk == 0)
+                chunk = stream_chunk_size(rt, elem_size) / elem_size;
+        if(chunk > count)
+                chunk = count;
+        num_sets = (count + chunk - 1) / chunk;
+        if(num_sets > STREAM_BUFFERS)
+                num_sets = STREAM_BUFFERS;
+
+        memset(written, 0, sizeof(written));
+        memset(computed, 0, sizeof(computed));
+        memset(read, 0, sizeof(read));
+        for(size_t b = 0; b < num_sets; b++) {
+                in[b] = bufpool_acquire(&rt->pool, CL_MEM_READ_ONLY, chunk * elem_size);
+                out[b] = bufpool_acquire(&rt->pool, CL_MEM_WRITE_ONLY, chunk * elem_size);
+        }
+
+        for(size_t offset = 0, k = 0; offset < count; offset += chunk, k++) {
+                size_t b = k % num_sets;
+                size_t n = (count - offset < chunk) ? count - offset : chunk;
+                cl_ulong n_arg = n;
+                cl_event event;
+
+                // Upload once the previous kernel on this set has consumed its input
+                err = clEnqueueWriteBuffer(rt->upload_queue, in[b], CL_FALSE, 0, n * elem_size,
+                                           (const char *)input + offset * elem_size,
+                                           (computed[b] != NULL) ? 1 : 0, (computed[b] != NULL) ? &computed[b] : NULL,
+                                           &event);
+		ocl_error("Enqueueing stream upload", err);
+                stream_replace_event(&written[b], event);
+                profile_event(&rt->profile, event, "stream input");
+
+                // Compute once the upload is done and the previous download has drained the output
+                cl_event wait[2];
+                cl_uint num_wait = 0;
+                wait[num_wait++] = written[b];
+                if(read[b] != NULL)
+                        wait[num_wait++] = read[b];
+
+                err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &in[b]);
+                err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &out[b]);
+                err |= clSetKernelArg(kernel, 2, sizeof(cl_ulong), &n_arg);
+		ocl_error("Setting stream kernel arguments", err);
+                err = opencl_enqueue_range(rt->queue, kernel, n, 0, num_wait, wait, &event);
+		ocl_error("Enqueueing stream kernel", err);
+                stream_replace_event(&computed[b], event);
+                profile_event(&rt->profile, event, "stream kernel");
+
+                // Download straight into the caller's output array
+                err = clEnqueueReadBuffer(rt->download_queue, out[b], CL_FALSE, 0, n * elem_size,
+                                          (char *)output + offset * elem_size, 1, &computed[b], &event);
+		ocl_error("Enqueueing stream download", err);
+                stream_replace_event(&read[b], event);
+                profile_event(&rt->profile, event, "stream output");
+
+                clFlush(rt->upload_queue);
+                clFlush(rt->queue);
+                clFlush(rt->download_queue);
+        }
+
+        for(size_t b = 0; b < num_sets; b++) {
+                if(read[b] != NULL) {
+                        err = clWaitForEvents(1, &read[b]);
+			ocl_error("Waiting for stream download", err);
+                }
+                stream_replace_event(&written[b], NULL);
+                stream_replace_event(&computed[b], NULL);
+                stream_replace_event(&read[b], NULL);
+                bufpool_release(&rt->pool, in[b]);
+                bufpool_release(&rt->pool, out[b]);
+        }
+}
@@ -0,0 +1,16 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+#define STREAM_BUFFERS (3)	// buffer sets in rotation: upload, compute, download
+
+size_t stream_chunk_size(struct ocl_runtime *rt, size_t elem_size);
+void stream_run(struct ocl_runtime *rt, cl_kernel kernel, const void *input, void *output,
+                size_t count, size_t elem_size, size_t chunk);
+
+#endif //STREAM_H
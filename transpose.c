@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "transpose.h"
+#include "util.h"
+
+
+/*
+ * Writes the transpose of the row-major 'rows' x 'cols' matrix of 32-bit
+ * elements in 'input' to 'output' ('cols' x 'rows'). The buffers must not
+ * overlap.
+ */
+void
+transpose_run(struct ocl_runtime *rt, cl_mem input, cl_mem output, size_t rows, size_t cols)
+{
+        cl_int err;
+        cl_event event;
+        cl_kernel kernel = opencl_require_kernel(rt, "transpose.cl", "transpose");
+        cl_uint rows_arg = rows;
+        cl_uint cols_arg = cols;
+        size_t global[2], local[2] = { TRANSPOSE_TILE, TRANSPOSE_ROWS };
+
+        if(rows == 0 || cols == 0)
+                return;
+        if(rows > 0xffffffffUL || cols > 0xffffffffUL) {
+                printf("Error: Unable to transpose a %lu x %lu matrix\n", (unsigned long)rows, (unsigned long)cols);
+                exit(1);
+        }
+
+        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_uint), &rows_arg);
+        err |= clSetKernelArg(kernel, 3, sizeof(cl_uint), &cols_arg);
+	ocl_error("Setting transpose kernel arguments", err);
+
+        // One work-group per tile, dimension 0 along the input's columns
+        global[0] = (cols + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE * TRANSPOSE_TILE;
+        global[1] = (rows + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE * TRANSPOSE_ROWS;
+        err = clEnqueueNDRangeKernel(rt->queue, kernel, 2, NULL, global, local, 0, NULL, &event);
+	ocl_error("Enqueueing transpose", err);
+        profile_event(&rt->profile, event, "transpose");
+        clReleaseEvent(event);
+}
+
+/*
+ * Runs the record conversion 'stage' for 'components' components over
+ * 'count' records.
+ */
+static void
+transpose_records(struct ocl_runtime *rt, const char *stage, unsigned int components, cl_mem input, cl_mem output,
+                  size_t count)
+{
+        char name[64];
+        cl_int err;
+        cl_event event;
+        cl_kernel kernel;
+        cl_ulong count_arg = count;
+        size_t local;
+
+        if(components < 2 || components > TRANSPOSE_MAX_COMPONENTS) {
+                printf("Error: Records of %u components are not supported\n", components);
+                exit(1);
+        }
+        if(count == 0)
+                return;
+
+        snprintf(name, sizeof(name), "%s_%u", stage, components);
+        kernel = opencl_require_kernel(rt, "transpose.cl", name);
+        local = opencl_local_size(rt, kernel, TRANSPOSE_LOCAL);
+
+        err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
+        err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &output);
+        err |= clSetKernelArg(kernel, 2, sizeof(cl_ulong), &count_arg);
+        err |= clSetKernelArg(kernel, 3, sizeof(cl_uint) * components * local, NULL);
+	ocl_error("Setting layout kernel arguments", err);
+        err = opencl_enqueue_range(rt->queue, kernel, (count + local - 1) / local * local, local, 0, NULL, &event);
+	ocl_error("Enqueueing layout conversion", err);
+        profile_event(&rt->profile, event, stage);
+        clReleaseEvent(event);
+}
+
+/*
+ * Converts 'count' records of 'components' (2 to 4) 32-bit elements stored
+ * together in 'aos' into one plane per component in 'soa', plane c holding
+ * component c of every record from element c * 'count' on.
+ */
+void
+transpose_aos_to_soa(struct ocl_runtime *rt, unsigned int components, cl_mem aos, cl_mem soa, size_t count)
+{
+        transpose_records(rt, "aos_to_soa", components, aos, soa, count);
+}
+
+/*
+ * The inverse of transpose_aos_to_soa().
+ */
+void
+transpose_soa_to_aos(struct ocl_runtime *rt, unsigned int components, cl_mem soa, cl_mem aos, size_t count)
+{
+        transpose_records(rt, "soa_to_aos", components, soa, aos, count);
+}
@@ -0,0 +1,82 @@
+/*
+ * Layout changes of 32-bit elements (float, int or uint alike, they are moved
+ * as bits).
+ *
+ * transpose turns a row-major rows x cols matrix into its cols x rows
+ * transpose. Each work-group stages one TRANSPOSE_TILE square tile in __local
+ * memory, so that both the reads and the writes run along rows. The tile is
+ * padded by one column, so reading it back by columns hits a different bank
+ * on every work-item.
+ *
+ * aos_to_soa_K and soa_to_aos_K convert between 'count' records of K
+ * components stored together (array of structs) and K planes of 'count'
+ * elements (struct of arrays, plane c starting at c * count). A work-group
+ * copies its records' contiguous block through __local memory, so that
+ * neither side is accessed with a stride of K.
+ */
+
+#define TRANSPOSE_TILE (16)	// must match transpose.h
+#define TRANSPOSE_ROWS (4)	// work-items along a tile's rows, each moves TILE / ROWS elements
+
+__kernel __attribute__((reqd_work_group_size(TRANSPOSE_TILE, TRANSPOSE_ROWS, 1)))
+void transpose(__global const uint* input, __global uint* output, const uint rows, const uint cols)
+{
+   __local uint tile[TRANSPOSE_TILE][TRANSPOSE_TILE + 1];
+   uint x = get_local_id(0);
+   uint y = get_local_id(1);
+   uint tile_row = get_group_id(1) * TRANSPOSE_TILE;
+   uint tile_col = get_group_id(0) * TRANSPOSE_TILE;
+
+   for(uint r = y; r < TRANSPOSE_TILE; r += TRANSPOSE_ROWS) {
+       if(tile_row + r < rows && tile_col + x < cols)
+           tile[r][x] = input[(size_t)(tile_row + r) * cols + tile_col + x];
+   }
+   barrier(CLK_LOCAL_MEM_FENCE);
+
+   // The tile lands at (tile_col, tile_row) of the output, read by columns
+   for(uint r = y; r < TRANSPOSE_TILE; r += TRANSPOSE_ROWS) {
+       if(tile_col + r < cols && tile_row + x < rows)
+           output[(size_t)(tile_col + r) * rows + tile_row + x] = tile[x][r];
+   }
+}
+
+#define LAYOUT(K)                                                                               \
+__kernel void aos_to_soa_##K(__global const uint* aos, __global uint* soa, const ulong count,  \
+                             __local uint* scratch)                                             \
+{                                                                                               \
+   size_t lid = get_local_id(0);                                                                \
+   size_t local_size = get_local_size(0);                                                       \
+   size_t first = get_global_id(0) - lid;                                                       \
+   size_t records = (count - first < local_size) ? count - first : local_size;                  \
+                                                                                                \
+   for(size_t j = lid; j < records * K; j += local_size)                                        \
+       scratch[j] = aos[first * K + j];                                                         \
+   barrier(CLK_LOCAL_MEM_FENCE);                                                                \
+                                                                                                \
+   if(lid < records) {                                                                          \
+       for(uint c = 0; c < K; c++)                                                              \
+           soa[c * count + first + lid] = scratch[lid * K + c];                                 \
+   }                                                                                            \
+}                                                                                               \
+                                                                                                \
+__kernel void soa_to_aos_##K(__global const uint* soa, __global uint* aos, const ulong count,  \
+                             __local uint* scratch)                                             \
+{                                                                                               \
+   size_t lid = get_local_id(0);                                                                \
+   size_t local_size = get_local_size(0);                                                       \
+   size_t first = get_global_id(0) - lid;                                                       \
+   size_t records = (count - first < local_size) ? count - first : local_size;                  \
+                                                                                                \
+   if(lid < records) {                                                                          \
+       for(uint c = 0; c < K; c++)                                                              \
+           scratch[lid * K + c] = soa[c * count + first + lid];                                 \
+   }                                                                                            \
+   barrier(CLK_LOCAL_MEM_FENCE);                                                                \
+                                                                                                \
+   for(size_t j = lid; j < records * K; j += local_size)                                        \
+       aos[first * K + j] = scratch[j];                                                         \
+}
+
+LAYOUT(2)
+LAYOUT(3)
+LAYOUT(4)
@@ -0,0 +1,19 @@
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+#define TRANSPOSE_TILE (16)		// tile edge, must match transpose.cl
+#define TRANSPOSE_ROWS (4)		// work-group rows, must match transpose.cl
+#define TRANSPOSE_LOCAL (256)		// largest work-group size of the record conversions
+#define TRANSPOSE_MAX_COMPONENTS (4)
+
+void transpose_run(struct ocl_runtime *rt, cl_mem input, cl_mem output, size_t rows, size_t cols);
+void transpose_aos_to_soa(struct ocl_runtime *rt, unsigned int components, cl_mem aos, cl_mem soa, size_t count);
+void transpose_soa_to_aos(struct ocl_runtime *rt, unsigned int components, cl_mem soa, cl_mem aos, size_t count);
+
+#endif //TRANSPOSE_H
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "tune.h"
+#include "util.h"
+
+#define TUNE_FILE "tuning.txt"
+#define TUNE_RUNS (3)
+#define TUNE_MAX_CANDIDATES (64)
+
+struct tune_config {
+        size_t local;		// 0 lets the driver choose
+        size_t round;		// global size is a multiple of this
+};
+
+
+/*
+ * Tuning results depend on the device, its driver, the kernel and roughly on
+ * the problem size, so sizes are bucketed by power of two. Specialized builds
+ * share their kernel names, so the program's build options are part of the
+ * kernel's identity.
+ */
+static uint64_t
+tune_key(struct ocl_runtime *rt, cl_kernel kernel, size_t work_items)
+{
+        char info[1024];
+        unsigned int bucket = 0;
+        uint64_t key = HASH_SEED;
+        cl_program program;
+        size_t options_size;
+
+        if(clGetDeviceInfo(rt->device, CL_DEVICE_NAME, sizeof(info), info, NULL) == CL_SUCCESS)
+                key = hash_string(info, key);
+        if(clGetDeviceInfo(rt->device, CL_DRIVER_VERSION, sizeof(info), info, NULL) == CL_SUCCESS)
+                key = hash_string(info, key);
+        if(clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, sizeof(info), info, NULL) == CL_SUCCESS)
+                key = hash_string(info, key);
+        if(clGetKernelInfo(kernel, CL_KERNEL_PROGRAM, sizeof(program), &program, NULL) == CL_SUCCESS &&
+           clGetProgramBuildInfo(program, rt->device, CL_PROGRAM_BUILD_OPTIONS, 0, NULL, &options_size) == CL_SUCCESS) {
+                char *options = malloc(options_size + 1);
+                if(options == NULL) {
+                        printf("Error: Out of memory hashing build options\n");
+                        exit(1);
+                }
+                if(clGetProgramBuildInfo(program, rt->device, CL_PROGRAM_BUILD_OPTIONS, options_size, options,
+                                         NULL) == CL_SUCCESS) {
+                        options[options_size] = '\0';
+                        key = hash_string(options, key);
+                }
+                free(options);
+        }
+        while(((size_t)1 << bucket) < work_items)
+                bucket++;
+        return hash_bytes(&bucket, sizeof(bucket), key);
+}
+
+static int
+tune_load(uint64_t key, size_t *local, size_t *round)
+{
+        char path[1024];
+        unsigned long long line_key;
+        unsigned long line_local, line_round;
+        int found = 0;
+        FILE *f;
+
+        if(!cache_path(TUNE_FILE, path, sizeof(path)) || (f = fopen(path, "r")) == NULL)
+                return 0;
+
+        // Later lines win, so a retuned kernel replaces its old entry
+        while(fscanf(f, "%llx %lu %lu", &line_key, &line_local, &line_round) == 3) {
+                if(line_key == key) {
+                        *local = line_local;
+                        *round = line_round;
+                        found = 1;
+                }
+        }
+        fclose(f);
+        return found;
+}
+
+static void
+tune_store(uint64_t key, size_t local, size_t round)
+{
+        char path[1024];
+        FILE *f;
+
+        if(!cache_path(TUNE_FILE, path, sizeof(path)) || (f = fopen(path, "a")) == NULL)
+                return;
+        fprintf(f, "%016llx %lu %lu\n", (unsigned long long)key, (unsigned long)local, (unsigned long)round);
+        fclose(f);
+}
+
+/*
+ * Configurations worth trying: the driver's own choice (local 0), and every
+ * power of two multiple of the preferred multiple up to the kernel's limit.
+ * Each local size is tried with the global size rounded up to a multiple of
+ * itself, and to a multiple of one work-group per compute unit so that the
+ * last wave keeps every compute unit busy.
+ */
+static unsigned int
+tune_candidates(struct ocl_runtime *rt, cl_kernel kernel, struct tune_config *candidates)
+{
+        cl_int err;
+        size_t max_local;
+        size_t multiple;
+        cl_uint compute_units;
+        unsigned int num = 0;
+
+        err  = clGetKernelWorkGroupInfo(kernel, rt->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_local),
+                                        &max_local, NULL);
+        err |= clGetKernelWorkGroupInfo(kernel, rt->device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+                                        sizeof(multiple), &multiple, NULL);
+	ocl_error("Failed to retrieve kernel work group info", err);
+        err = clGetDeviceInfo(rt->device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+	ocl_error("Unable to get device info", err);
+
+        if(multiple == 0 || multiple > max_local)
+                multiple = 1;
+
+        candidates[num].local = 0;
+        candidates[num++].round = 1;
+        for(size_t local = multiple; local <= max_local && num + 2 <= TUNE_MAX_CANDIDATES; local *= 2) {
+                candidates[num].local = local;
+                candidates[num++].round = local;
+                if(compute_units > 1) {
+                        candidates[num].local = local;
+                        candidates[num++].round = local * compute_units;
+                }
+        }
+        return num;
+}
+
+/*
+ * Best of TUNE_RUNS timed launches, after one warmup. Returns a negative time
+ * if the configuration can not be launched.
+ */
+static double
+tune_time(cl_command_queue queue, cl_kernel kernel, size_t work_items, const struct tune_config *config)
+{
+        double best = -1.0;
+        size_t local = config->local;
+        size_t global = tune_global_size(work_items, config->round);
+
+        for(int run = 0; run <= TUNE_RUNS; run++) {
+                cl_event event;
+                cl_ulong start, end;
+                cl_int err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global, (local > 0) ? &local : NULL,
+                                                    0, NULL, &event);
+                if(err != CL_SUCCESS)
+                        return -1.0;
+                err  = clWaitForEvents(1, &event);
+                err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+                err |= clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+                clReleaseEvent(event);
+                if(err != CL_SUCCESS)
+                        return -1.0;
+
+                double ms = (end - start) * 1e-6;
+                if(run > 0 && (best < 0.0 || ms < best))
+                        best = ms;
+        }
+        return best;
+}
+
+/*
+ * Smallest multiple of 'round' covering 'work_items'. The kernels ignore the
+ * padding work-items past the end of their data.
+ */
+size_t
+tune_global_size(size_t work_items, size_t round)
+{
+        if(round <= 1)
+                return work_items;
+        return (work_items + round - 1) / round * round;
+}
+
+/*
+ * Returns the fastest local work size for launching 'kernel' over
+ * 'work_items' (0 meaning the driver's choice, pass NULL as local) and the
+ * matching global size. The first call for a device, driver, kernel and size
+ * bucket times every candidate and stores the winner in the tuning database,
+ * later calls (in this or any later process) only look it up.
+ *
+ * The kernel's arguments must already be set, and running it repeatedly must
+ * be harmless.
+ */
+void
+tune_local_size(struct ocl_runtime *rt, cl_kernel kernel, size_t work_items, size_t *local, size_t *global)
+{
+        cl_int err;
+        cl_command_queue queue;
+        struct tune_config candidates[TUNE_MAX_CANDIDATES];
+        struct tune_config best_config = { 0, 1 };
+        unsigned int num;
+        double best = -1.0;
+        uint64_t key = tune_key(rt, kernel, work_items);
+
+        if(!tune_load(key, &best_config.local, &best_config.round)) {
+                // The tuning queue must see the kernel's inputs as enqueued so far
+                clFinish(rt->queue);
+                queue = clCreateCommandQueue(rt->context, rt->device, CL_QUEUE_PROFILING_ENABLE, &err);
+		ocl_error("Creating command queue", err);
+
+                // Ranges split over several launches are timed on their first launch
+                size_t tune_items = (work_items < OPENCL_MAX_LAUNCH / 2) ? work_items : OPENCL_MAX_LAUNCH / 2;
+
+                num = tune_candidates(rt, kernel, candidates);
+                for(unsigned int i = 0; i < num; i++) {
+                        double ms = tune_time(queue, kernel, tune_items, &candidates[i]);
+                        if(ms >= 0.0 && (best < 0.0 || ms < best)) {
+                                best = ms;
+                                best_config = candidates[i];
+                        }
+                }
+                clReleaseCommandQueue(queue);
+
+                if(best >= 0.0)
+                        tune_store(key, best_config.local, best_config.round);
+        }
+        *local = best_config.local;
+        *global = tune_global_size(work_items, best_config.round);
+}
@@ -0,0 +1,13 @@
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <stddef.h>
+
+#include "CL/cl.h"
+
+#include "opencl.h"
+
+size_t tune_global_size(size_t work_items, size_t round);
+void tune_local_size(struct ocl_runtime *rt, cl_kernel kernel, size_t work_items, size_t *local, size_t *global);
+
+#endif //TUNE_H
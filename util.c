@@ -1,31 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 #include "opencl.h"
 #include "util.h"
 
-char *
-file_contents(const char *filename, int *length)
+/*
+ * Maps all of 'filename' into memory without copying it. The pages are
+ * private and page-aligned, so they can back a CL_MEM_USE_HOST_PTR buffer
+ * directly, and are only read from disk as they are touched. Files that can
+ * not be mapped (pipes, some network filesystems) are read into the heap
+ * instead. Returns 0 if the file can not be opened or read.
+ */
+int
+map_file(const char *filename, struct mapped_file *file)
 {
-        FILE *f = fopen(filename, "r");
-        void *buffer;
+        struct stat st;
+        int fd = open(filename, O_RDONLY);
 
-        if (f == NULL) {
+        memset(file, 0, sizeof(*file));
+        if(fd < 0 || fstat(fd, &st) != 0) {
                 fprintf(stderr, "Unable to open %s for reading\n", filename);
-                return NULL;
+                if(fd >= 0)
+                        close(fd);
+                return 0;
+        }
+
+        if(S_ISREG(st.st_mode) && st.st_size > 0) {
+                // Writable but private: drivers may pin the pages for writing, the file never changes
+                file->data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                if(file->data != MAP_FAILED) {
+                        posix_madvise(file->data, st.st_size, POSIX_MADV_SEQUENTIAL);
+                        file->size = st.st_size;
+                        file->mapped = 1;
+                        close(fd);
+                        return 1;
+                }
+                file->data = NULL;
+        }
+
+        // Read whatever is there, growing the buffer as needed
+        size_t capacity = 0;
+        ssize_t n;
+        do {
+                if(file->size == capacity) {
+                        capacity = (capacity > 0) ? capacity * 2 : 65536;
+                        void *data = realloc(file->data, capacity);
+                        if(data == NULL) {
+                                printf("Error: Out of memory reading %s\n", filename);
+                                exit(1);
+                        }
+                        file->data = data;
+                }
+                n = read(fd, (char *)file->data + file->size, capacity - file->size);
+                if(n > 0)
+                        file->size += n;
+        } while(n > 0 || (n < 0 && errno == EINTR));
+        close(fd);
+
+        if(n < 0) {
+                fprintf(stderr, "Unable to read %s\n", filename);
+                unmap_file(file);
+                return 0;
+        }
+        return 1;
+}
+
+void
+unmap_file(struct mapped_file *file)
+{
+        if(file->mapped)
+                munmap(file->data, file->size);
+        else
+                free(file->data);
+        memset(file, 0, sizeof(*file));
+}
+
+
+/*
+ * Monotonic wall-clock time in seconds, for measuring intervals.
+ */
+double
+time_seconds(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*
+ * Creates 'dir' and any missing parents. Returns 0 on failure.
+ */
+static int
+make_dirs(char *dir)
+{
+        for(char *p = dir + 1; *p; p++) {
+                if(*p != '/')
+                        continue;
+                *p = '\0';
+                if(mkdir(dir, 0755) != 0 && errno != EEXIST) {
+                        *p = '/';
+                        return 0;
+                }
+                *p = '/';
         }
+        return (mkdir(dir, 0755) == 0 || errno == EEXIST);
+}
+
+/*
+ * Writes the path of the cache file 'name' into 'path', creating the cache
+ * directory if needed. The directory is $OPENCL_CACHE_DIR, or
+ * $XDG_CACHE_HOME/opencl_c99_sample, or ~/.cache/opencl_c99_sample.
+ * Returns 0 if caching is disabled ($OPENCL_NO_CACHE) or no directory is usable.
+ */
+int
+cache_path(const char *name, char *path, size_t path_len)
+{
+        char dir[1024];
+        const char *env;
+        int len;
+
+        if(getenv("OPENCL_NO_CACHE") != NULL)
+                return 0;
 
-        fseek(f, 0, SEEK_END);
-        *length = ftell(f);
-        fseek(f, 0, SEEK_SET);
+        if((env = getenv("OPENCL_CACHE_DIR")) != NULL && env[0] != '\0')
+                len = snprintf(dir, sizeof(dir), "%s", env);
+        else if((env = getenv("XDG_CACHE_HOME")) != NULL && env[0] != '\0')
+                len = snprintf(dir, sizeof(dir), "%s/opencl_c99_sample", env);
+        else if((env = getenv("HOME")) != NULL && env[0] != '\0')
+                len = snprintf(dir, sizeof(dir), "%s/.cache/opencl_c99_sample", env);
+        else
+                return 0;
 
-        buffer = malloc(*length+1);
-        *length = fread(buffer, 1, *length, f);
-        fclose(f);
-        ((char*)buffer)[*length] = '\0';
+        if(len < 0 || (size_t)len >= sizeof(dir) || !make_dirs(dir))
+                return 0;
 
-        return (char*)buffer;
+        len = snprintf(path, path_len, "%s/%s", dir, name);
+        return (len >= 0 && (size_t)len < path_len);
 }
 
 
@@ -1,11 +1,26 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stddef.h>
+
 #include "CL/cl.h"
 
-char *file_contents(const char *filename, int *length);
+/*
+ * A private copy of a whole file, memory-mapped copy-on-write where
+ * possible. Writes to 'data' never reach the file.
+ */
+struct mapped_file {
+        void *data;
+        size_t size;
+        int mapped;			// 'data' is an mmap() of the file, not a heap copy
+};
+
+int map_file(const char *filename, struct mapped_file *file);
+void unmap_file(struct mapped_file *file);
 const char* ocl_error_string(cl_int error);
 void ocl_error(const char *descr, cl_int err);
+double time_seconds(void);
+int cache_path(const char *name, char *path, size_t path_len);
 
 
 #endif //UTIL_H_OPENSSL
\ No newline at end of file